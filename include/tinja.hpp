@@ -1,155 +1,2536 @@
 #pragma once
 
+#include <algorithm>
+#include <array>
+#include <charconv>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
 #include <functional>
+#include <limits>
+#include <memory>
+#include <memory_resource>
+#include <optional>
+#include <stdexcept>
 #include <string>
+#include <string_view>
+#include <type_traits>
 #include <unordered_map>
+#include <utility>
 #include <variant>
 #include <vector>
 
+#if __has_include(<sys/uio.h>)
+#include <climits>
+#include <sys/uio.h>
+#ifdef IOV_MAX
+#define TINJA_IOV_MAX IOV_MAX
+#else
+#define TINJA_IOV_MAX 1024
+#endif
+#endif
+
+#if defined(__AVX2__) || defined(__SSE2__)
+#include <immintrin.h>
+#endif
+
+// Per template counters (see TemplateStats), must be equal in all translation units. Disabled
+// hooks compile to nothing.
+#ifndef TINJA_STATS
+#define TINJA_STATS 0
+#endif
+
+#if TINJA_STATS
+#include <chrono>
+#include <mutex>
+#endif
+
+// AVX2 delimiter scanning, selected at compile time or (GCC/Clang on x86) at runtime
+#if defined(__AVX2__)
+#define TINJA_AVX2 1
+#define TINJA_AVX2_TARGET
+#elif defined(__SSE2__) && (defined(__x86_64__) || defined(__i386__)) && (defined(__GNUC__) || defined(__clang__))
+#define TINJA_AVX2 1
+#define TINJA_AVX2_TARGET __attribute__((target("avx2")))
+#else
+#define TINJA_AVX2 0
+#endif
+
 namespace tinja {
 
-using String = std::string;
-using StringRef = std::reference_wrapper<const String>;
-using Strings = std::vector<String>;
-using StringRefs = std::vector<StringRef>;
-using Data = std::variant<String,StringRef,Strings,StringRefs>;
-using DataMap = std::unordered_map<String, Data>;
+using String = std::string;
+using StringRef = std::reference_wrapper<const String>;
+using Strings = std::vector<String>;
+using StringRefs = std::vector<StringRef>;
+
+using StringView = std::string_view;
+using StringViews = std::vector<StringView>;
+
+// Non-owning, strided array of numbers or strings, e.g. a field of an array of structs. Numbers are
+// formatted with std::to_chars while rendering instead of holding one string per element. Only views
+// the elements, which must outlive rendering.
+class Column {
+public:
+    enum class Type : uint8_t {
+        Int32,
+        Int64,
+        UInt32,
+        UInt64,
+        Float,
+        Double,
+        String,
+        StringView
+    };
+
+    // Maximum size of a formatted number
+    static constexpr size_t maxChars = 64;
+
+    // Floating point numbers are formatted with fixed precision, or shortest if precision is negative
+    template<class T>
+    Column(const T* data, size_t size, int precision = -1) :
+        Column(data, size, sizeof(T), typeOf<T>(), precision) {
+    }
+
+    template<class T>
+    Column(const std::vector<T>& values, int precision = -1) :
+        Column(values.data(), values.size(), precision) {
+    }
+
+    // Columns only view their elements, temporaries would dangle
+    template<class T>
+    Column(const std::vector<T>&&, int = -1) = delete;
+
+    // Field of an array of structs: Column(samples, &Sample::temperature)
+    template<class S, class T>
+    Column(const S* data, size_t size, T S::* member, int precision = -1) :
+        Column(size ? &(data->*member) : nullptr, size, sizeof(S), typeOf<T>(), precision) {
+    }
+
+    template<class S, class T>
+    Column(const std::vector<S>& values, T S::* member, int precision = -1) :
+        Column(values.data(), values.size(), member, precision) {
+    }
+
+    template<class S, class T>
+    Column(const std::vector<S>&&, T S::*, int = -1) = delete;
+
+    size_t size() const {
+        return _size;
+    }
+
+    Type type() const {
+        return _type;
+    }
+
+    bool isText() const {
+        return _type == Type::String || _type == Type::StringView;
+    }
+
+    bool isInteger() const {
+        return _type <= Type::UInt64;
+    }
+
+    // Obtain element at index of an integer column
+    size_t integer(size_t index) const {
+        switch (_type) {
+        case Type::Int32:
+            return static_cast<size_t>(at<int32_t>(index));
+        case Type::Int64:
+            return static_cast<size_t>(at<int64_t>(index));
+        case Type::UInt32:
+            return at<uint32_t>(index);
+        case Type::UInt64:
+            return static_cast<size_t>(at<uint64_t>(index));
+        default:
+            return 0;
+        }
+    }
+
+    // Obtain element at index of a text column
+    tinja::StringView text(size_t index) const {
+        if (_type == Type::String) {
+            return at<tinja::String>(index);
+        }
+        return at<tinja::StringView>(index);
+    }
+
+    // Format element at index of a numeric column into buffer of maxChars, returns formatted size
+    size_t format(size_t index, char* buffer) const {
+        switch (_type) {
+        case Type::Int32:
+            return toChars(buffer, at<int32_t>(index));
+        case Type::Int64:
+            return toChars(buffer, at<int64_t>(index));
+        case Type::UInt32:
+            return toChars(buffer, at<uint32_t>(index));
+        case Type::UInt64:
+            return toChars(buffer, at<uint64_t>(index));
+        case Type::Float:
+            return toChars(buffer, at<float>(index));
+        case Type::Double:
+            return toChars(buffer, at<double>(index));
+        default:
+            return 0;
+        }
+    }
+
+private:
+    Column(const void* data, size_t size, size_t stride, Type type, int precision) :
+        _data(static_cast<const char*>(data)),
+        _size(size),
+        _stride(stride),
+        _type(type),
+        _precision(static_cast<int16_t>(std::min(precision, 17))) {
+    }
+
+    template<class T>
+    static constexpr Type typeOf() {
+        using U = std::remove_cv_t<T>;
+        if constexpr (std::is_same_v<U, tinja::String>) {
+            return Type::String;
+        } else if constexpr (std::is_same_v<U, tinja::StringView>) {
+            return Type::StringView;
+        } else if constexpr (std::is_same_v<U, float>) {
+            return Type::Float;
+        } else if constexpr (std::is_same_v<U, double>) {
+            return Type::Double;
+        } else {
+            static_assert(std::is_integral_v<U> && !std::is_same_v<U, bool> && (sizeof(U) == 4 || sizeof(U) == 8),
+                          "tinja::Column: use 32/64 bit integers, float, double or strings");
+            if constexpr (std::is_signed_v<U>) {
+                return sizeof(U) == 4 ? Type::Int32 : Type::Int64;
+            } else {
+                return sizeof(U) == 4 ? Type::UInt32 : Type::UInt64;
+            }
+        }
+    }
+
+    template<class T>
+    const T& at(size_t index) const {
+        if (index >= _size) {
+            throw std::out_of_range("tinja::Column: index out of range");
+        }
+        return *reinterpret_cast<const T*>(_data + index * _stride);
+    }
+
+    template<class T>
+    size_t toChars(char* buffer, T value) const {
+        if constexpr (std::is_floating_point_v<T>) {
+            if (_precision >= 0) {
+                const auto result = std::to_chars(buffer, buffer + maxChars, value, std::chars_format::fixed, _precision);
+                if (result.ec == std::errc()) {
+                    return result.ptr - buffer;
+                }
+                // Too large for fixed notation
+                return std::to_chars(buffer, buffer + maxChars, value, std::chars_format::general, _precision).ptr - buffer;
+            }
+        }
+        return std::to_chars(buffer, buffer + maxChars, value).ptr - buffer;
+    }
+
+    const char* _data;
+    size_t _size;
+    size_t _stride;
+    Type _type;
+    int16_t _precision;
+};
+
+// Non-owning nested array in CSR layout, for array blocks within array blocks. Holds the values of
+// the innermost level (flattened) and, for each enclosing level from the outermost, the offsets of
+// its rows into the next level (rows + 1 ascending integers). E.g. values { a, b, c, d, e } with
+// offsets { 0, 3, 5 } are the rows { a, b, c } and { d, e }. Rows of nested blocks are indexed by
+// their position within all rows of their level, so jagged columns of one level share offsets.
+class JaggedColumn {
+public:
+    JaggedColumn(Column values, Column offsets) :
+        JaggedColumn(values, std::vector<Column> { offsets }) {
+    }
+
+    JaggedColumn(Column values, std::vector<Column> offsets) :
+        _values(values),
+        _offsets(std::move(offsets)) {
+        for (size_t level = 0; level < _offsets.size(); ++level) {
+            const auto& column = _offsets[level];
+            if (!column.isInteger() || column.size() == 0) {
+                throw std::invalid_argument("tinja::JaggedColumn: offsets must be non-empty integer columns");
+            }
+            // Negative offsets are cast to values beyond the size of the next level
+            const auto nextSize = level + 1 < _offsets.size() ? _offsets[level+1].size() - 1 : _values.size();
+            for (size_t i = 1; i < column.size(); ++i) {
+                if (column.integer(i) < column.integer(i-1)) {
+                    throw std::invalid_argument("tinja::JaggedColumn: offsets must be ascending");
+                }
+            }
+            if (column.integer(column.size() - 1) > nextSize) {
+                throw std::invalid_argument("tinja::JaggedColumn: offsets exceed the next level");
+            }
+        }
+    }
+
+    // Values and offsets are only viewed, temporaries would dangle
+    template<class T>
+    JaggedColumn(const std::vector<T>&&, Column) = delete;
+
+    template<class T>
+    JaggedColumn(const std::vector<T>&&, std::vector<Column>) = delete;
+
+    template<class T, class = std::enable_if_t<!std::is_same_v<T, Column>>>
+    JaggedColumn(Column, const std::vector<T>&&) = delete;
+
+    const Column& values() const {
+        return _values;
+    }
+
+    // Nesting levels: levels of offsets plus the level of values
+    size_t levels() const {
+        return _offsets.size() + 1;
+    }
+
+    // Obtain rows [first, second) of level (< levels()) within row parent of the enclosing level
+    std::pair<size_t, size_t> rows(size_t level, size_t parent) const {
+        if (level == 0) {
+            return { 0, _offsets.empty() ? _values.size() : _offsets.front().size() - 1 };
+        }
+        const auto& offsets = _offsets[level-1];
+        return { offsets.integer(parent), offsets.integer(parent + 1) };
+    }
+
+private:
+    Column _values;
+    std::vector<Column> _offsets;
+};
+
+// Data of a variable: a string (view), an array of strings or numbers or a jagged column
+struct Data : std::variant<String,StringRef,Strings,StringRefs,Column,StringView,JaggedColumn> {
+    using variant::variant;
+
+    // String literals are copied (otherwise ambiguous between String and StringView)
+    Data(const char* str) :
+        variant(String(str)) {
+    }
+};
+
+// Hash of DataMap keys, transparent for lookups by view where the standard library supports them
+struct KeyHash {
+    using is_transparent = void;
+
+    size_t operator()(StringView key) const {
+        return std::hash<StringView>()(key);
+    }
+};
+
+using DataMap = std::unordered_map<String, Data, KeyHash, std::equal_to<>>;
+
+// Lookup data of key without allocating a key string
+inline const Data* findData(const DataMap& dataMap, StringView key) {
+#ifdef __cpp_lib_generic_unordered_lookup
+    const auto it = dataMap.find(key);
+#else
+    // No heterogeneous lookup before C++20: copy into a buffer of the calling thread, which keeps
+    // its capacity across lookups
+    thread_local String buffer;
+    buffer.assign(key);
+    const auto it = dataMap.find(buffer);
+#endif
+    return it == dataMap.end() ? nullptr : &it->second;
+}
+
+// This is our overload operator
+template<typename... Ts>
+struct Overload : Ts... {
+    using Ts::operator()...;
+};
+template<class... Ts> Overload(Ts...) -> Overload<Ts...>;
+
+// Obtain value of (array) data at index
+inline const String& valueAt(const Data& data, size_t index) {
+    // Switch on index instead of std::visit, which lets the compiler inline this on the hot path
+    switch (data.index()) {
+    case 0:
+        return *std::get_if<0>(&data);
+    case 1:
+        return std::get_if<1>(&data)->get();
+    case 2:
+        return std::get_if<2>(&data)->at(index);
+    case 3:
+        return std::get_if<3>(&data)->at(index).get();
+    default: {
+        // Columns and views have no strings, they are formatted or viewed by a FormatArena
+        static const String empty;
+        return empty;
+    }
+    }
+}
+
+// Obtain array size of data (rows of the outermost level of jagged columns), npos for regular variables
+inline size_t arraySize(const Data& data) {
+    // Switch on index, std::visit of a class derived from std::variant needs a recent standard library
+    switch (data.index()) {
+    case 2:
+        return std::get_if<2>(&data)->size();
+    case 3:
+        return std::get_if<3>(&data)->size();
+    case 4:
+        return std::get_if<4>(&data)->size();
+    case 6:
+        return std::get_if<6>(&data)->rows(0, 0).second;
+    default:
+        return String::npos;
+    }
+}
+
+// Obtain column of data, nullptr for strings
+inline const Column* columnOf(const Data& data) {
+    if (const auto* jagged = std::get_if<6>(&data)) {
+        return &jagged->values();
+    }
+    return std::get_if<4>(&data);
+}
+
+// Obtain nesting levels of data: 0 for regular variables, 1 for arrays, more for jagged columns
+inline size_t levelsOf(const Data& data) {
+    switch (data.index()) {
+    case 2:
+    case 3:
+    case 4:
+        return 1;
+    case 6:
+        return std::get_if<6>(&data)->levels();
+    default:
+        return 0;
+    }
+}
+
+// Storage for values formatted during a render, reused across renders.
+// Formatted values stay valid until the arena is cleared.
+class FormatArena {
+public:
+    // Arena of the calling thread, cleared by each render
+    static FormatArena& local() {
+        thread_local FormatArena arena;
+        return arena;
+    }
+
+    void clear() {
+        _chunk = 0;
+        _offset = 0;
+        _stringCount = 0;
+    }
+
+    // Obtain value of data without string (see hasString()), numbers are formatted into the arena
+    StringView format(const Data& data, size_t index) {
+        if (const auto* view = std::get_if<5>(&data)) {
+            return *view;
+        }
+        const auto& column = *columnOf(data);
+        if (column.isText()) {
+            return column.text(index);
+        }
+        if (_chunks.empty() || _offset + Column::maxChars > chunkSize) {
+            if (!_chunks.empty()) {
+                ++_chunk;
+                _offset = 0;
+            }
+            if (_chunk == _chunks.size()) {
+                _chunks.push_back(std::make_unique<char[]>(chunkSize));
+            }
+        }
+        auto* buffer = _chunks[_chunk].get() + _offset;
+        const auto size = column.format(index, buffer);
+        _offset += size;
+        return StringView(buffer, size);
+    }
+
+    // Copy str into a string, for tokens referencing strings
+    const String& keep(StringView str) {
+        auto& string_ = string();
+        string_.assign(str);
+        return string_;
+    }
+
+    // Obtain an empty string (keeping its capacity from previous renders)
+    String& string() {
+        if (_stringCount == _strings.size()) {
+            _strings.push_back(std::make_unique<String>());
+        }
+        auto& string_ = *_strings[_stringCount++];
+        string_.clear();
+        return string_;
+    }
+
+private:
+    static constexpr size_t chunkSize = 4096;
+
+    std::vector<std::unique_ptr<char[]>> _chunks;
+    size_t _chunk = 0;
+    size_t _offset = 0;
+    std::vector<std::unique_ptr<String>> _strings;
+    size_t _stringCount = 0;
+};
+
+// Check if valueAt() holds the value of data, otherwise it is obtained with FormatArena::format()
+inline bool hasString(const Data& data) {
+    return data.index() < 4;
+}
+
+// Obtain size of value of data at index
+inline size_t valueSize(const Data& data, size_t index) {
+    if (hasString(data)) {
+        return valueAt(data, index).size();
+    }
+    if (const auto* column = columnOf(data); column && !column->isText()) {
+        char buffer[Column::maxChars];
+        return column->format(index, buffer);
+    }
+    return FormatArena().format(data, index).size();
+}
+
+// Position within nested array blocks: index of the row of the innermost block, nesting depth (0
+// outside of blocks) and position within the enclosing block
+struct Row {
+    size_t index = 0;
+    size_t depth = 0;
+    const Row* outer = nullptr;
+
+    // Obtain index of data: arrays are indexed by the row of the outermost block, jagged columns by
+    // the row of the block at their innermost level
+    size_t indexOf(const Data& data) const {
+        if (depth <= 1) {
+            return index;
+        }
+        const auto levels = levelsOf(data);
+        const auto* row = this;
+        while (levels != 0 && levels < row->depth) {
+            row = row->outer;
+        }
+        return row->index;
+    }
+};
+
+// Rows [begin, end) of an array block, narrowed by the data of the variables within it. Unbounded
+// blocks render once.
+struct Rows {
+    size_t begin = 0;
+    size_t end = std::numeric_limits<size_t>::max();
+
+    // Narrow to the rows of data at level (depth of the enclosing block) within row parent of the
+    // enclosing block. Regular variables and arrays of enclosing blocks are ignored.
+    void narrow(const Data& data, size_t level, size_t parent) {
+        if (levelsOf(data) <= level) {
+            return;
+        }
+        const auto* jagged = std::get_if<6>(&data);
+        const auto rows = jagged ? jagged->rows(level, parent) : std::pair<size_t, size_t>(0, arraySize(data));
+        begin = std::max(begin, rows.first);
+        end = std::min(end, rows.second);
+    }
+
+    void clear() {
+        end = begin;
+    }
+
+    size_t size() const {
+        if (end == std::numeric_limits<size_t>::max()) {
+            return 1;
+        }
+        return end > begin ? end - begin : 0;
+    }
+};
+
+// Find first occurrence of c1 followed by c2 or c3 in str, starting at pos (scalar version)
+inline size_t findDelimiterScalar(StringView str, size_t pos, char c1, char c2, char c3) {
+    const auto size = str.size();
+    const auto* data = str.data();
+    while (pos + 1 < size) {
+        const auto* next = static_cast<const char*>(std::memchr(data + pos, c1, size - pos - 1));
+        if (!next) {
+            break;
+        }
+        pos = next - data;
+        if (data[pos+1] == c2 || data[pos+1] == c3) {
+            return pos;
+        }
+        ++pos;
+    }
+    return String::npos;
+}
+
+#if defined(__SSE2__)
+// SSE2 version: screens 16 bytes per step for c1 and only classifies blocks containing candidates
+inline size_t findDelimiterSse2(StringView str, size_t pos, char c1, char c2, char c3) {
+    const auto size = str.size();
+    const auto* data = str.data();
+    const auto v1 = _mm_set1_epi8(c1);
+    const auto v2 = _mm_set1_epi8(c2);
+    const auto v3 = _mm_set1_epi8(c3);
+    // Second characters are loaded at offset 1, so keep one byte of headroom
+    for (; pos + 16 + 1 <= size; pos += 16) {
+        const auto first = static_cast<uint32_t>(_mm_movemask_epi8(_mm_cmpeq_epi8(
+            _mm_loadu_si128(reinterpret_cast<const __m128i*>(data + pos)), v1)));
+        if (!first) {
+            continue;
+        }
+        const auto second = _mm_loadu_si128(reinterpret_cast<const __m128i*>(data + pos + 1));
+        const auto match = first & static_cast<uint32_t>(_mm_movemask_epi8(
+            _mm_or_si128(_mm_cmpeq_epi8(second, v2), _mm_cmpeq_epi8(second, v3))));
+        if (match) {
+            return pos + __builtin_ctz(match);
+        }
+    }
+    return findDelimiterScalar(str, pos, c1, c2, c3);
+}
+#endif
+
+#if TINJA_AVX2
+// AVX2 version: screens 64 bytes per step for c1 and only classifies blocks containing candidates
+TINJA_AVX2_TARGET inline size_t findDelimiterAvx2(StringView str, size_t pos, char c1, char c2, char c3) {
+    const auto size = str.size();
+    const auto* data = str.data();
+    const auto v1 = _mm256_set1_epi8(c1);
+    const auto v2 = _mm256_set1_epi8(c2);
+    const auto v3 = _mm256_set1_epi8(c3);
+    // Second characters are loaded at offset 1, so keep one byte of headroom
+    for (; pos + 64 + 1 <= size; pos += 64) {
+        const auto first0 = _mm256_cmpeq_epi8(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(data + pos)), v1);
+        const auto first1 = _mm256_cmpeq_epi8(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(data + pos + 32)), v1);
+        const auto any = _mm256_or_si256(first0, first1);
+        if (_mm256_testz_si256(any, any)) {
+            continue;
+        }
+        const auto second0 = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(data + pos + 1));
+        const auto second1 = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(data + pos + 33));
+        const uint64_t match0 = static_cast<uint32_t>(_mm256_movemask_epi8(_mm256_and_si256(first0,
+            _mm256_or_si256(_mm256_cmpeq_epi8(second0, v2), _mm256_cmpeq_epi8(second0, v3)))));
+        const uint64_t match1 = static_cast<uint32_t>(_mm256_movemask_epi8(_mm256_and_si256(first1,
+            _mm256_or_si256(_mm256_cmpeq_epi8(second1, v2), _mm256_cmpeq_epi8(second1, v3)))));
+        if (const auto match = match0 | (match1 << 32)) {
+            return pos + __builtin_ctzll(match);
+        }
+    }
+    return findDelimiterScalar(str, pos, c1, c2, c3);
+}
+#endif
+
+// Find first occurrence of c1 followed by c2 or c3 in str, starting at pos.
+// Uses AVX2 (if built for it or detected at runtime), SSE2 or the scalar version.
+inline size_t findDelimiter(StringView str, size_t pos, char c1, char c2, char c3) {
+#if defined(__AVX2__)
+    return findDelimiterAvx2(str, pos, c1, c2, c3);
+#elif TINJA_AVX2
+    static const bool hasAvx2 = __builtin_cpu_supports("avx2");
+    return hasAvx2 ? findDelimiterAvx2(str, pos, c1, c2, c3) : findDelimiterSse2(str, pos, c1, c2, c3);
+#elif defined(__SSE2__)
+    return findDelimiterSse2(str, pos, c1, c2, c3);
+#else
+    return findDelimiterScalar(str, pos, c1, c2, c3);
+#endif
+}
+
+// Find "]}" closing the array block whose content starts at pos, skipping nested blocks
+constexpr size_t findArrayEnd(StringView str, size_t pos) {
+    size_t depth = 0;
+    auto open = str.find("{[", pos);
+    auto close = str.find("]}", pos);
+    while (close != String::npos) {
+        if (open < close) {
+            ++depth;
+            open = str.find("{[", open + 2);
+        } else if (depth == 0) {
+            return close;
+        } else {
+            --depth;
+            close = str.find("]}", close + 2);
+        }
+    }
+    return String::npos;
+}
+
+inline bool isHtmlSpecial(char c) {
+    return c == '<' || c == '>' || c == '&' || c == '"' || c == '\'';
+}
+
+// Find first HTML special character (<>&"') in str, starting at pos (scalar version)
+inline size_t findHtmlSpecialScalar(StringView str, size_t pos) {
+    for (; pos < str.size(); ++pos) {
+        if (isHtmlSpecial(str[pos])) {
+            return pos;
+        }
+    }
+    return String::npos;
+}
+
+#if defined(__SSE2__)
+// SSE2 version: classifies 16 bytes per step
+inline size_t findHtmlSpecialSse2(StringView str, size_t pos) {
+    const auto size = str.size();
+    const auto* data = str.data();
+    for (; pos + 16 <= size; pos += 16) {
+        const auto v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(data + pos));
+        const auto special = _mm_or_si128(
+            _mm_or_si128(_mm_cmpeq_epi8(v, _mm_set1_epi8('<')), _mm_cmpeq_epi8(v, _mm_set1_epi8('>'))),
+            _mm_or_si128(_mm_or_si128(_mm_cmpeq_epi8(v, _mm_set1_epi8('&')), _mm_cmpeq_epi8(v, _mm_set1_epi8('"'))),
+                         _mm_cmpeq_epi8(v, _mm_set1_epi8('\''))));
+        if (const auto match = static_cast<uint32_t>(_mm_movemask_epi8(special))) {
+            return pos + __builtin_ctz(match);
+        }
+    }
+    return findHtmlSpecialScalar(str, pos);
+}
+#endif
+
+#if TINJA_AVX2
+// AVX2 version: classifies 32 bytes per step
+TINJA_AVX2_TARGET inline size_t findHtmlSpecialAvx2(StringView str, size_t pos) {
+    const auto size = str.size();
+    const auto* data = str.data();
+    for (; pos + 32 <= size; pos += 32) {
+        const auto v = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(data + pos));
+        const auto special = _mm256_or_si256(
+            _mm256_or_si256(_mm256_cmpeq_epi8(v, _mm256_set1_epi8('<')), _mm256_cmpeq_epi8(v, _mm256_set1_epi8('>'))),
+            _mm256_or_si256(_mm256_or_si256(_mm256_cmpeq_epi8(v, _mm256_set1_epi8('&')), _mm256_cmpeq_epi8(v, _mm256_set1_epi8('"'))),
+                            _mm256_cmpeq_epi8(v, _mm256_set1_epi8('\''))));
+        if (const auto match = static_cast<uint32_t>(_mm256_movemask_epi8(special))) {
+            return pos + __builtin_ctz(match);
+        }
+    }
+    return findHtmlSpecialScalar(str, pos);
+}
+#endif
+
+// Find first HTML special character (<>&"') in str, starting at pos
+inline size_t findHtmlSpecial(StringView str, size_t pos = 0) {
+#if defined(__AVX2__)
+    return findHtmlSpecialAvx2(str, pos);
+#elif TINJA_AVX2
+    static const bool hasAvx2 = __builtin_cpu_supports("avx2");
+    return hasAvx2 ? findHtmlSpecialAvx2(str, pos) : findHtmlSpecialSse2(str, pos);
+#elif defined(__SSE2__)
+    return findHtmlSpecialSse2(str, pos);
+#else
+    return findHtmlSpecialScalar(str, pos);
+#endif
+}
+
+inline StringView htmlEntity(char c) {
+    switch (c) {
+    case '<': return "&lt;";
+    case '>': return "&gt;";
+    case '&': return "&amp;";
+    case '"': return "&quot;";
+    default: return "&#39;";
+    }
+}
+
+// Append str to out, with HTML special characters replaced by entities
+inline void appendEscapedHtml(String& out, StringView str) {
+    size_t begin = 0;
+    for (auto pos = findHtmlSpecial(str); pos != String::npos; pos = findHtmlSpecial(str, begin)) {
+        out.append(str, begin, pos - begin);
+        out.append(htmlEntity(str[pos]));
+        begin = pos + 1;
+    }
+    out.append(str, begin);
+}
+
+// Obtain size of str with HTML special characters escaped
+inline size_t escapedHtmlSize(StringView str) {
+    auto size = str.size();
+    for (auto pos = findHtmlSpecial(str); pos != String::npos; pos = findHtmlSpecial(str, pos + 1)) {
+        size += htmlEntity(str[pos]).size() - 1;
+    }
+    return size;
+}
+
+// Obtain size of value of data at index after HTML escaping (numbers need none)
+inline size_t escapedHtmlSize(const Data& data, size_t index) {
+    if (hasString(data)) {
+        return escapedHtmlSize(StringView(valueAt(data, index)));
+    }
+    if (const auto* column = columnOf(data); column && !column->isText()) {
+        return valueSize(data, index);
+    }
+    return escapedHtmlSize(FormatArena().format(data, index));
+}
+
+// Escape str into a string of arena, nullptr if str has no HTML special characters (nothing is copied)
+inline const String* escapeHtml(StringView str, FormatArena& arena) {
+    if (findHtmlSpecial(str) == String::npos) {
+        return nullptr;
+    }
+    auto& escaped = arena.string();
+    escaped.reserve(escapedHtmlSize(str));
+    appendEscapedHtml(escaped, str);
+    return &escaped;
+}
+
+// Maps variable names to integer slots.
+// Templates are bound against a schema once, so rendering from DataSlots does no key lookups.
+class Schema {
+public:
+    static constexpr size_t npos = std::numeric_limits<size_t>::max();
+
+    Schema() = default;
+    Schema(std::initializer_list<String> keys) {
+        for (const auto& key : keys) {
+            slot(key);
+        }
+    }
+
+    // Obtain slot of key, adds key if not present
+    size_t slot(const String& key) {
+        const auto [it, isNew] = _slots.emplace(key, _slots.size());
+        if (isNew) {
+            _keys.push_back(key);
+        }
+        return it->second;
+    }
+
+    // Obtain slot of key, npos if not present
+    size_t find(const String& key) const {
+        const auto it = _slots.find(key);
+        return it == _slots.end() ? npos : it->second;
+    }
+
+    size_t size() const {
+        return _slots.size();
+    }
+
+    // Keys indexed by slot
+    const Strings& keys() const {
+        return _keys;
+    }
+
+private:
+    std::unordered_map<String, size_t> _slots;
+    Strings _keys;
+};
+
+// Slot indexed data container, replaces DataMap for bound templates
+class DataSlots {
+public:
+    explicit DataSlots(const Schema& schema, std::pmr::memory_resource* resource = std::pmr::get_default_resource()) :
+        _schema(schema),
+        _data(schema.size(), resource) {
+    }
+
+    // Access data by key (one lookup, use slots on the hot path)
+    std::optional<Data>& operator[](const String& key) {
+        return _data.at(_schema.find(key));
+    }
+
+    std::optional<Data>& operator[](size_t slot) {
+        return _data.at(slot);
+    }
+
+    const Data* find(size_t slot) const {
+        return (slot < _data.size() && _data[slot]) ? &*_data[slot] : nullptr;
+    }
+
+    const Schema& schema() const {
+        return _schema;
+    }
+
+private:
+    const Schema& _schema;
+    std::pmr::vector<std::optional<Data>> _data;
+};
+
+// Compare data by content. References are never considered equal, since their target may have been
+// modified in place.
+inline bool isSameData(const Data& lhs, const Data& rhs) {
+    if (lhs.index() != rhs.index()) {
+        return false;
+    }
+    switch (lhs.index()) {
+    case 0:
+        return std::get<0>(lhs) == std::get<0>(rhs);
+    case 2:
+        return std::get<2>(lhs) == std::get<2>(rhs);
+    default:
+        return false;
+    }
+}
+
+// Slot indexed data container recording which slots changed, used for incremental rendering
+class TrackedSlots {
+public:
+    explicit TrackedSlots(const Schema& schema) :
+        _slots(schema),
+        _isChanged(schema.size()) {
+    }
+
+    // Set data of slot, returns false if data is equal to the current data (nothing is marked)
+    bool set(size_t slot, Data data) {
+        auto& current = _slots[slot];
+        if (current && isSameData(*current, data)) {
+            return false;
+        }
+        current = std::move(data);
+        touch(slot);
+        return true;
+    }
+
+    bool set(const String& key, Data data) {
+        return set(_slots.schema().find(key), std::move(data));
+    }
+
+    void reset(size_t slot) {
+        if (_slots[slot]) {
+            _slots[slot].reset();
+            touch(slot);
+        }
+    }
+
+    // Mark slot as changed, e.g. after modifying referenced data in place
+    void touch(size_t slot) {
+        if (!_isChanged.at(slot)) {
+            _isChanged[slot] = true;
+            _changes.push_back(slot);
+        }
+    }
+
+    bool isChanged(size_t slot) const {
+        return _isChanged.at(slot);
+    }
+
+    // Slots changed since last call of clearChanges()
+    const std::vector<size_t>& changes() const {
+        return _changes;
+    }
+
+    void clearChanges() {
+        for (const auto slot : _changes) {
+            _isChanged[slot] = false;
+        }
+        _changes.clear();
+    }
+
+    const DataSlots& slots() const {
+        return _slots;
+    }
+
+private:
+    DataSlots _slots;
+    std::vector<bool> _isChanged;
+    std::vector<size_t> _changes;
+};
+
+// Sink appending to a growable string
+struct StringSink {
+    void operator()(StringView str) {
+        out.append(str);
+    }
+
+    String& out;
+};
+
+// Sink collecting into a fixed size buffer, which is handed to flush whenever it is full.
+// Call flush() once rendering is done to hand over the remainder.
+template<size_t N, class Flush>
+class ChunkedSink {
+public:
+    explicit ChunkedSink(Flush flush) :
+        _flush(std::move(flush)) {
+    }
+
+    void operator()(StringView str) {
+        // Hand over large tokens directly instead of copying them chunk-wise
+        if (_size == 0 && str.size() >= N) {
+            _flush(str);
+            return;
+        }
+        while (!str.empty()) {
+            const auto count = std::min(N - _size, str.size());
+            std::memcpy(_buffer.data() + _size, str.data(), count);
+            _size += count;
+            str.remove_prefix(count);
+            if (_size == N) {
+                flush();
+            }
+        }
+    }
+
+    void flush() {
+        if (_size) {
+            _flush(StringView(_buffer.data(), _size));
+            _size = 0;
+        }
+    }
+
+private:
+    Flush _flush;
+    std::array<char, N> _buffer;
+    size_t _size = 0;
+};
+
+#if __has_include(<sys/uio.h>)
+// Sink gathering tokens into a reusable iovec array without copying them. The array is handed to
+// flush (e.g. writev or sendmsg) in batches of at most N entries.
+// Call flush() once rendering is done to hand over the remainder.
+template<class Flush, size_t N = TINJA_IOV_MAX>
+class IovecSink {
+public:
+    explicit IovecSink(Flush flush) :
+        _flush(std::move(flush)),
+        _iovs(N) {
+    }
+
+    void operator()(StringView str) {
+        _iovs[_count].iov_base = const_cast<char*>(str.data());
+        _iovs[_count].iov_len = str.size();
+        if (++_count == N) {
+            flush();
+        }
+    }
+
+    void flush() {
+        if (_count) {
+            _flush(static_cast<const iovec*>(_iovs.data()), static_cast<int>(_count));
+            _count = 0;
+        }
+    }
+
+private:
+    Flush _flush;
+    std::vector<iovec> _iovs;
+    size_t _count = 0;
+};
+#endif
+
+// Worker threads for parallel and batch rendering, defined by tinja_threads.hpp. Members taking a
+// pool are templates, so rendering without one needs no threading support.
+class ThreadPool;
+
+// Constrains members taking a pool
+template<class Pool>
+using IfPool = std::enable_if_t<std::is_same_v<Pool, ThreadPool>>;
+
+// Documents of a batch render, stored back to back in one buffer
+class Batch {
+public:
+    size_t size() const {
+        return _offsets.size() - 1;
+    }
+
+    StringView operator[](size_t i) const {
+        return StringView(_text).substr(_offsets.at(i), _offsets.at(i+1) - _offsets[i]);
+    }
+
+    // All documents, document i spans [offsets()[i], offsets()[i+1])
+    const String& text() const {
+        return _text;
+    }
+
+    const std::vector<size_t>& offsets() const {
+        return _offsets;
+    }
+
+    // Remove all documents, keeping the capacity for the next batch
+    void clear() {
+        _text.clear();
+        _offsets.resize(1);
+    }
+
+private:
+    template<class TextT>
+    friend class BasicTemplate;
+
+    String _text;
+    std::vector<size_t> _offsets = { 0 };
+};
+
+// Snapshot of the counters of a template, all zero unless built with TINJA_STATS
+struct TemplateStats {
+    uint64_t parses = 0;
+    uint64_t parseNanoseconds = 0;
+    uint64_t renders = 0;
+    uint64_t renderNanoseconds = 0;
+    uint64_t tokens = 0;
+    uint64_t bytes = 0;
+    // Variable lookups (including those for loop lengths) and lookups of missing keys
+    uint64_t lookups = 0;
+    uint64_t missingKeys = 0;
+    // Array expansions and their iterations
+    uint64_t loops = 0;
+    uint64_t loopIterations = 0;
+
+    TemplateStats& operator+=(const TemplateStats& other) {
+        parses += other.parses;
+        parseNanoseconds += other.parseNanoseconds;
+        renders += other.renders;
+        renderNanoseconds += other.renderNanoseconds;
+        tokens += other.tokens;
+        bytes += other.bytes;
+        lookups += other.lookups;
+        missingKeys += other.missingKeys;
+        loops += other.loops;
+        loopIterations += other.loopIterations;
+        return *this;
+    }
+};
+
+using StatsCounter = uint64_t TemplateStats::*;
+
+// Instrumentation hooks of a template, empty if disabled
+template<bool isEnabled>
+class StatsCounters {
+public:
+    class Scope {
+    public:
+        Scope(const StatsCounters&, StatsCounter, StatsCounter) {}
+        explicit Scope(const StatsCounters*) {}
+    };
+
+    static const StatsCounters* active() {
+        return nullptr;
+    }
+
+    static void count(StatsCounter, uint64_t = 1) {}
+
+    void enable() {}
+
+    TemplateStats snapshot() const {
+        return {};
+    }
+
+    void reset() {}
+};
+
+#if TINJA_STATS
+// Counts into a thread local snapshot of the current scope, which is added to the counters once
+// when the scope (a parse, render or worker task) ends. Counters are allocated by enable() for top
+// level templates only, nested templates just hold an empty pointer.
+template<>
+class StatsCounters<true> {
+public:
+    StatsCounters() = default;
+
+    // Copies start counting from zero
+    StatsCounters(const StatsCounters& other) :
+        _counters(other._counters ? std::make_unique<Counters>() : nullptr) {
+    }
+
+    StatsCounters& operator=(const StatsCounters& other) {
+        _counters = other._counters ? std::make_unique<Counters>() : nullptr;
+        return *this;
+    }
+
+    StatsCounters(StatsCounters&&) noexcept = default;
+    StatsCounters& operator=(StatsCounters&&) noexcept = default;
+
+    class Scope {
+    public:
+        // Outermost scope of a parse or render of a template, counts one event (unless nullptr) and
+        // its duration. Renders of other templates (e.g. from a sink) open their own scope.
+        Scope(const StatsCounters& counters, StatsCounter event, StatsCounter nanoseconds) :
+            Scope(counters._counters && !(current() && current()->_counters == &counters) ? &counters : nullptr) {
+            if (_counters) {
+                if (event) {
+                    _stats.*event = 1;
+                }
+                _nanoseconds = nanoseconds;
+                _start = std::chrono::steady_clock::now();
+            }
+        }
+
+        // Scope of a worker task, counting for the scope that started it
+        explicit Scope(const StatsCounters* counters) :
+            _counters(counters) {
+            if (_counters) {
+                _previous = current();
+                current() = this;
+            }
+        }
+
+        ~Scope() {
+            if (!_counters) {
+                return;
+            }
+            if (_nanoseconds) {
+                _stats.*_nanoseconds += static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(
+                    std::chrono::steady_clock::now() - _start).count());
+            }
+            current() = _previous;
+            auto& counters = *_counters->_counters;
+            std::lock_guard lock(counters.mutex);
+            counters.stats += _stats;
+        }
+
+        Scope(const Scope&) = delete;
+        Scope& operator=(const Scope&) = delete;
+
+    private:
+        friend class StatsCounters;
+
+        const StatsCounters* _counters;
+        Scope* _previous = nullptr;
+        TemplateStats _stats;
+        StatsCounter _nanoseconds = nullptr;
+        std::chrono::steady_clock::time_point _start;
+    };
+
+    // Counters of the scope running on this thread, to hand over to worker tasks
+    static const StatsCounters* active() {
+        return current() ? current()->_counters : nullptr;
+    }
+
+    static void count(StatsCounter counter, uint64_t n = 1) {
+        if (auto* scope = current()) {
+            scope->_stats.*counter += n;
+        }
+    }
+
+    void enable() {
+        if (!_counters) {
+            _counters = std::make_unique<Counters>();
+        }
+    }
+
+    TemplateStats snapshot() const {
+        if (!_counters) {
+            return {};
+        }
+        std::lock_guard lock(_counters->mutex);
+        return _counters->stats;
+    }
+
+    void reset() {
+        if (_counters) {
+            std::lock_guard lock(_counters->mutex);
+            _counters->stats = {};
+        }
+    }
+
+private:
+    struct Counters {
+        std::mutex mutex;
+        TemplateStats stats;
+    };
+
+    static Scope*& current() {
+        thread_local Scope* scope = nullptr;
+        return scope;
+    }
+
+    std::unique_ptr<Counters> _counters;
+};
+#endif
+
+using Stats = StatsCounters<TINJA_STATS>;
+
+template<class TextT>
+class BasicTemplate;
+
+// Template owning a copy of each text node
+using Template = BasicTemplate<String>;
+// Template with text nodes being views into a retained (owned or borrowed) source
+using TemplateView = BasicTemplate<StringView>;
+// Template with all nodes and text allocated from its memory resource, e.g. a per request arena
+using PmrTemplate = BasicTemplate<std::pmr::string>;
+
+class Program;
+
+// Options of BasicTemplate::parse()
+struct ParseOptions {
+    // Collapse whitespace runs after '>' and before '<' in text nodes (variables are kept as is)
+    bool minifyHtml = false;
+    // Escape HTML special characters (<>&"') of all variables while rendering
+    bool escapeHtml = false;
+};
+
+template<class T>
+class IncrementalRenderer;
+
+template<class T>
+class StreamParser;
+
+template<class TextT>
+class BasicTemplate : private Stats {
+public:
+    static constexpr bool isView = std::is_same_v<TextT, StringView>;
+    static constexpr bool isPmr = std::is_same_v<TextT, std::pmr::string>;
+    using Tokens = std::conditional_t<isPmr, std::pmr::vector<StringView>, std::conditional_t<isView, StringViews, StringRefs>>;
+    using MemoryResource = std::pmr::memory_resource;
+
+    // Nodes (of all nesting levels) are allocated from resource. Copies use the default resource.
+    BasicTemplate(size_t reserveNodes = 0, MemoryResource* resource = std::pmr::get_default_resource()) :
+        _nodes(resource),
+        _lastNodeCount(reserveNodes) {
+    }
+
+    BasicTemplate(StringView str, size_t reserveNodes = 0, MemoryResource* resource = std::pmr::get_default_resource()) :
+        _nodes(resource),
+        _lastNodeCount(reserveNodes) {
+        parse(str);
+    }
+
+    BasicTemplate(const char* str, size_t reserveNodes = 0, MemoryResource* resource = std::pmr::get_default_resource()) :
+        _nodes(resource),
+        _lastNodeCount(reserveNodes) {
+        parse(str);
+    }
+
+    BasicTemplate(String&& str, size_t reserveNodes = 0, MemoryResource* resource = std::pmr::get_default_resource()) :
+        _nodes(resource),
+        _lastNodeCount(reserveNodes) {
+        parse(std::move(str));
+    }
+
+    MemoryResource* resource() const {
+        return _nodes.get_allocator().resource();
+    }
+
+    // Parse input string to nodes. A TemplateView borrows str, which must outlive it.
+    size_t parse(StringView str, ParseOptions options = {}) {
+        enable();
+        Scope scope(*this, &TemplateStats::parses, &TemplateStats::parseNanoseconds);
+        _source.reset();
+        const auto count = parseNodes(str, nullptr, options);
+        indexVariables();
+        return count;
+    }
+
+    size_t parse(const char* str, ParseOptions options = {}) {
+        return parse(StringView(str), options);
+    }
+
+    // Resolves names of partials ({{>name}}) to templates, whose nodes are expanded in place.
+    // Partials of a TemplateView must outlive it.
+    using Resolver = std::function<const BasicTemplate*(StringView name)>;
+
+    // Parse input string to nodes, expanding partials. Unresolved partials render nothing.
+    size_t parse(StringView str, const Resolver& resolve, ParseOptions options = {}) {
+        enable();
+        Scope scope(*this, &TemplateStats::parses, &TemplateStats::parseNanoseconds);
+        _source.reset();
+        const auto count = parseNodes(str, &resolve, options);
+        indexVariables();
+        return count;
+    }
+
+    // Parse input string to nodes. A TemplateView takes ownership of str.
+    size_t parse(String&& str, ParseOptions options = {}) {
+        if constexpr (isView) {
+            enable();
+            Scope scope(*this, &TemplateStats::parses, &TemplateStats::parseNanoseconds);
+            auto source = std::make_shared<const String>(std::move(str));
+            const auto count = parseNodes(*source, nullptr, options);
+            indexVariables();
+            _source = std::move(source);
+            return count;
+        } else {
+            return parse(StringView(str), options);
+        }
+    }
+
+    // Resolve variables to slots of schema (adds unknown keys to schema)
+    void bind(Schema& schema) {
+        for (auto& node : _nodes) {
+            switch (node.index()) {
+            case 1: {
+                auto& var = std::get<1>(node);
+                var.slot = schema.slot(key(var.name));
+                break;
+            }
+            case 2:
+                std::get<2>(node).bind(schema);
+                break;
+            default:
+                break;
+            }
+        }
+    }
+
+    // Counters of parses and renders of this template since its first parse, all zero unless built
+    // with TINJA_STATS. Copies start from zero.
+    TemplateStats stats() const {
+        return snapshot();
+    }
+
+    void resetStats() {
+        reset();
+    }
+
+    // Render to tokens. Tokens of formatted columns are valid until the next render on this thread.
+    void renderTo(const DataMap& dataMap, Tokens& tokens) const {
+        renderTokens(dataMap, tokens, local());
+    }
+
+    // Render from slots, template must be bound to the schema of dataSlots
+    void renderTo(const DataSlots& dataSlots, Tokens& tokens) const {
+        renderTokens(dataSlots, tokens, local());
+    }
+
+    // Obtain exact size of the rendered output, e.g. to pick an output buffer before rendering
+    size_t renderedSize(const DataMap& dataMap) const {
+        return renderedSize(dataMap, Row {});
+    }
+
+    size_t renderedSize(const DataSlots& dataSlots) const {
+        return renderedSize(dataSlots, Row {});
+    }
+
+    // Render to a string with exactly one allocation
+    String render(const DataMap& dataMap) const {
+        return render(dataMap, Row {});
+    }
+
+    String render(const DataSlots& dataSlots) const {
+        return render(dataSlots, Row {});
+    }
+
+    // Render directly into a sink, which is called with a StringView for each non-empty token
+    template<class Sink, class = std::enable_if_t<std::is_invocable_v<Sink&, StringView>>>
+    void renderTo(const DataMap& dataMap, Sink&& sink) const {
+        Scope scope(*this, &TemplateStats::renders, &TemplateStats::renderNanoseconds);
+        renderTo(dataMap, [&](StringView str) { sink(str); }, Row {}, local());
+    }
+
+    template<class Sink, class = std::enable_if_t<std::is_invocable_v<Sink&, StringView>>>
+    void renderTo(const DataSlots& dataSlots, Sink&& sink) const {
+        Scope scope(*this, &TemplateStats::renders, &TemplateStats::renderNanoseconds);
+        renderTo(dataSlots, [&](StringView str) { sink(str); }, Row {}, local());
+    }
+
+    // Render with arrays of at least 2 * pool.minChunkSize() elements split into chunks, which are
+    // rendered in parallel. Chunks are emitted as one token each, valid until the next render on this thread.
+    template<class Pool, class = IfPool<Pool>>
+    void renderTo(const DataMap& dataMap, Tokens& tokens, Pool& pool) const {
+        renderTokens(dataMap, tokens, local(), &pool);
+    }
+
+    template<class Pool, class = IfPool<Pool>>
+    void renderTo(const DataSlots& dataSlots, Tokens& tokens, Pool& pool) const {
+        renderTokens(dataSlots, tokens, local(), &pool);
+    }
+
+    template<class Sink, class Pool, class = std::enable_if_t<std::is_invocable_v<Sink&, StringView>>, class = IfPool<Pool>>
+    void renderTo(const DataMap& dataMap, Sink&& sink, Pool& pool) const {
+        Scope scope(*this, &TemplateStats::renders, &TemplateStats::renderNanoseconds);
+        renderParallel(dataMap, [&](StringView str) { sink(str); }, local(), pool);
+    }
+
+    template<class Sink, class Pool, class = std::enable_if_t<std::is_invocable_v<Sink&, StringView>>, class = IfPool<Pool>>
+    void renderTo(const DataSlots& dataSlots, Sink&& sink, Pool& pool) const {
+        Scope scope(*this, &TemplateStats::renders, &TemplateStats::renderNanoseconds);
+        renderParallel(dataSlots, [&](StringView str) { sink(str); }, local(), pool);
+    }
+
+    template<class Pool, class = IfPool<Pool>>
+    String render(const DataMap& dataMap, Pool& pool) const {
+        String str;
+        renderTo(dataMap, StringSink { str }, pool);
+        return str;
+    }
+
+    template<class Pool, class = IfPool<Pool>>
+    String render(const DataSlots& dataSlots, Pool& pool) const {
+        String str;
+        renderTo(dataSlots, StringSink { str }, pool);
+        return str;
+    }
+
+    // Render each data source (DataMap or DataSlots) of sources and append the documents to batch.
+    // Keys are resolved once per document instead of once per use, documents are rendered in
+    // parallel if a pool is given.
+    template<class Range, class Pool = void, class = std::enable_if_t<std::is_void_v<Pool> || std::is_same_v<Pool, ThreadPool>>>
+    void renderBatch(const Range& sources, Batch& batch, Pool* pool = nullptr) const {
+        // Documents count as renders
+        Scope scope(*this, nullptr, &TemplateStats::renderNanoseconds);
+        using Source = std::decay_t<decltype(*std::begin(sources))>;
+        if constexpr (std::is_same_v<Source, DataMap>) {
+            // Map variables to the distinct keys, which are resolved with one lookup per document
+            Schema schema;
+            std::vector<size_t> slots;
+            indexKeys(schema, slots);
+            renderItems(sources, batch, pool, [&](const DataMap& dataMap, DataPointers& pointers) -> const DataPointers& {
+                pointers.slots = &slots;
+                pointers.data.resize(schema.size());
+                for (size_t slot = 0; slot < pointers.data.size(); ++slot) {
+                    const auto it = dataMap.find(schema.keys()[slot]);
+                    pointers.data[slot] = it == dataMap.end() ? nullptr : &it->second;
+                }
+                return pointers;
+            });
+        } else {
+            static_assert(std::is_same_v<Source, DataSlots>, "tinja::BasicTemplate::renderBatch: sources must hold DataMap or DataSlots");
+            renderItems(sources, batch, pool, [](const DataSlots& dataSlots, DataPointers&) -> const DataSlots& {
+                return dataSlots;
+            });
+        }
+    }
+
+private:
+    friend class Program;
+    friend class IncrementalRenderer<BasicTemplate>;
+    friend class StreamParser<BasicTemplate>;
+
+    // Data of each key of a batch document, resolved from a DataMap. Variables map to keys through
+    // their index.
+    struct DataPointers {
+        std::vector<const Data*> data;
+        const std::vector<size_t>* slots = nullptr;
+    };
+
+    template<class Range, class Pool, class Resolve>
+    void renderItems(const Range& sources, Batch& batch, Pool* pool, Resolve&& resolve) const {
+        const auto first = std::begin(sources);
+        const auto count = static_cast<size_t>(std::distance(first, std::end(sources)));
+        const auto renderRange = [&](size_t begin, size_t end, String& text, std::vector<size_t>& offsets) {
+            DataPointers pointers;
+            auto& arena = FormatArena::local();
+            for (auto i = begin; i < end; ++i) {
+                arena.clear();
+                Stats::count(&TemplateStats::renders);
+                renderTo(resolve(first[i], pointers), StringSink { text }, Row {}, arena);
+                offsets.push_back(text.size());
+            }
+        };
+
+        const auto chunkCount = chunkCountOf(pool, count);
+        if (chunkCount <= 1) {
+            batch._offsets.reserve(batch._offsets.size() + count);
+            renderRange(0, count, batch._text, batch._offsets);
+            return;
+        }
+
+        if constexpr (!std::is_void_v<Pool>) {
+            std::vector<String> texts(chunkCount);
+            std::vector<std::vector<size_t>> offsets(chunkCount);
+            const auto* counters = active();
+            pool->run(chunkCount, [&](size_t c) {
+                Scope scope(counters);
+                renderRange(count * c / chunkCount, count * (c + 1) / chunkCount, texts[c], offsets[c]);
+            });
+            size_t size = batch._text.size();
+            for (const auto& text : texts) {
+                size += text.size();
+            }
+            batch._text.reserve(size);
+            for (size_t c = 0; c < chunkCount; ++c) {
+                const auto base = batch._text.size();
+                batch._text.append(texts[c]);
+                for (const auto offset : offsets[c]) {
+                    batch._offsets.push_back(base + offset);
+                }
+            }
+        }
+    }
+
+    // Obtain number of chunks to split count documents into, 1 without pool
+    template<class Pool>
+    static size_t chunkCountOf(const Pool* pool, size_t count) {
+        if constexpr (std::is_void_v<Pool>) {
+            return 1;
+        } else {
+            return pool && pool->workerCount() ? std::min(count, (pool->workerCount() + 1) * 4) : 1;
+        }
+    }
+
+    using Text = TextT;
+    struct Variable {
+        Variable(TextT name_, bool isEscaped_ = false) : name(std::move(name_)), isEscaped(isEscaped_) {}
+        TextT name;
+        size_t slot = Schema::npos;
+        // Position among the variables of all nesting levels of the parsed template
+        size_t index = Schema::npos;
+        bool isEscaped;
+    };
+    using Node = std::variant<Text, Variable, BasicTemplate>;
+
+    // Number variables of all nesting levels in order of appearance, returns the next index
+    size_t indexVariables(size_t index = 0) {
+        for (auto& node : _nodes) {
+            if (auto* var = std::get_if<1>(&node)) {
+                var->index = index++;
+            } else if (auto* doc = std::get_if<2>(&node)) {
+                index = doc->indexVariables(index);
+            }
+        }
+        return index;
+    }
+
+    // Add keys of all variables to schema, slots maps the index of each variable to its slot
+    void indexKeys(Schema& schema, std::vector<size_t>& slots) const {
+        for (const auto& node : _nodes) {
+            if (const auto* var = std::get_if<1>(&node); var && var->index != Schema::npos) {
+                if (var->index >= slots.size()) {
+                    slots.resize(var->index + 1, Schema::npos);
+                }
+                slots[var->index] = schema.slot(key(var->name));
+            } else if (const auto* doc = std::get_if<2>(&node)) {
+                doc->indexKeys(schema, slots);
+            }
+        }
+    }
+
+    size_t parseNodes(StringView str, const Resolver* resolve = nullptr, ParseOptions options = {}) {
+        _nodes.clear();
+        _nodes.reserve(_lastNodeCount);
+        _textSize = 0;
+        size_t pos = 0;
+
+        while (pos < str.size()) {
+            // Text until next "{{" or "{[" (tags need at least one more character after the delimiter)
+            const auto open = findDelimiter(str, pos, '{', '{', '[');
+            if (open == String::npos || open+3 >= str.size()) {
+                pushNode<0>(str, pos, str.size(), resolve, options);
+                break;
+            }
+            pushNode<0>(str, pos, open, resolve, options);
+
+            // Variable until "}}", array until its matching "]}" (closing delimiters are near, a plain
+            // find is fastest)
+            const auto isArray = str[open+1] == '[';
+            pos = open + 2;
+            const auto close = isArray ? findArrayEnd(str, pos) : str.find("}}", pos);
+            if (close == String::npos) {
+                break;
+            }
+            if (isArray) {
+                pushNode<2>(str, pos, close, resolve, options);
+            } else {
+                pushNode<1>(str, pos, close, resolve, options);
+            }
+            pos = close + 2;
+        }
+        _lastNodeCount = _nodes.size();
+        return _nodes.size();
+    }
+
+    template<size_t S>
+    void pushNode(StringView str, size_t from, size_t to, const Resolver* resolve, ParseOptions options) {
+        if (from >= to || str.size() <= from)
+            return;
+        const auto sub = str.substr(from, to-from);
+        if constexpr (S == 2) {
+            // Nested templates parse from the same source, without an intermediate copy
+            _nodes.emplace_back(std::in_place_index<2>, 0, resource());
+            std::get<2>(_nodes.back()).parseNodes(sub, resolve, options);
+        } else if (S == 0 && options.minifyHtml) {
+            pushMinified(sub);
+        } else if (S == 1 && resolve && sub.front() == '>') {
+            // Expand partial
+            if (const auto* partial = (*resolve)(sub.substr(1))) {
+                appendNodes(partial->_nodes);
+                _textSize += partial->_textSize;
+            }
+        } else if (S == 1) {
+            _nodes.emplace_back(std::in_place_index<1>, text(sub), options.escapeHtml);
+        } else {
+            _textSize += sub.size();
+            _nodes.emplace_back(std::in_place_index<0>, text(sub));
+        }
+    }
+
+    // Append copies of nodes (of all nesting levels), allocated from the resource of this template
+    // instead of the default resource of plain node copies
+    void appendNodes(const std::pmr::vector<Node>& nodes) {
+        _nodes.reserve(_nodes.size() + nodes.size());
+        for (const auto& node : nodes) {
+            switch (node.index()) {
+            case 0:
+                _nodes.emplace_back(std::in_place_index<0>, text(std::get<0>(node)));
+                break;
+            case 1: {
+                const auto& var = std::get<1>(node);
+                auto& copy = std::get<1>(_nodes.emplace_back(std::in_place_index<1>, text(var.name), var.isEscaped));
+                copy.slot = var.slot;
+                break;
+            }
+            default: {
+                const auto& doc = std::get<2>(node);
+                auto& copy = std::get<2>(_nodes.emplace_back(std::in_place_index<2>, 0, resource()));
+                copy.appendNodes(doc._nodes);
+                copy._lastNodeCount = doc._lastNodeCount;
+                copy._textSize = doc._textSize;
+                break;
+            }
+            }
+        }
+    }
+
+    // Push text node without whitespace between HTML tags. Views split the text node around
+    // removed whitespace instead of copying it.
+    void pushMinified(StringView str) {
+        auto minified = text({});
+        if constexpr (!isView) {
+            minified.reserve(str.size());
+        }
+        forEachMinified(str, [&](StringView piece) {
+            _textSize += piece.size();
+            if constexpr (isView) {
+                _nodes.emplace_back(std::in_place_index<0>, piece);
+            } else {
+                minified.append(piece);
+            }
+        });
+        if constexpr (!isView) {
+            if (!minified.empty()) {
+                _nodes.emplace_back(std::in_place_index<0>, std::move(minified));
+            }
+        }
+    }
+
+    // Call f with the (non-empty) pieces of str between whitespace runs preceded by '>' or followed
+    // by '<' (in one pass, equal to regex replacing "\s+<" by "<" and ">\s+" by ">")
+    template<class F>
+    static void forEachMinified(StringView str, F&& f) {
+        const auto isSpace = [](char c) {
+            return c == ' ' || c == '\n' || c == '\t' || c == '\r' || c == '\f' || c == '\v';
+        };
+        size_t begin = 0;
+        size_t pos = 0;
+        while (pos < str.size()) {
+            if (!isSpace(str[pos])) {
+                ++pos;
+                continue;
+            }
+            auto end = pos + 1;
+            while (end < str.size() && isSpace(str[end])) {
+                ++end;
+            }
+            if ((pos > 0 && str[pos-1] == '>') || (end < str.size() && str[end] == '<')) {
+                if (pos > begin) {
+                    f(str.substr(begin, pos - begin));
+                }
+                begin = end;
+            }
+            pos = end;
+        }
+        if (pos > begin) {
+            f(str.substr(begin, pos - begin));
+        }
+    }
+
+    TextT text(StringView str) const {
+        if constexpr (isPmr) {
+            return TextT(str, resource());
+        } else {
+            return TextT(str);
+        }
+    }
+
+    // Obtain key of variable name for schemas (views need a key string)
+    static const String& key(const String& name) {
+        return name;
+    }
+
+    static String key(StringView name) {
+        return String(name);
+    }
+
+    // Lookup data of variable
+    static const Data* find(const DataMap& dataMap, const Variable& var) {
+        if constexpr (std::is_same_v<TextT, String>) {
+            const auto it = dataMap.find(var.name);
+            return it == dataMap.end() ? nullptr : &it->second;
+        } else {
+            return findData(dataMap, var.name);
+        }
+    }
+
+    static const Data* find(const DataSlots& dataSlots, const Variable& var) {
+        return dataSlots.find(var.slot);
+    }
+
+    static const Data* find(const DataPointers& pointers, const Variable& var) {
+        return var.index < pointers.slots->size() ? pointers.data[(*pointers.slots)[var.index]] : nullptr;
+    }
+
+    // Clear and obtain arena for formatted columns
+    static FormatArena& local() {
+        auto& arena = FormatArena::local();
+        arena.clear();
+        return arena;
+    }
+
+    template<class Source, class Pool = void>
+    void renderTokens(const Source& source, Tokens& tokens, FormatArena& arena, Pool* pool = nullptr) const {
+        Scope scope(*this, &TemplateStats::renders, &TemplateStats::renderNanoseconds);
+        tokens.clear();
+        const auto emit = [&](const auto& str) {
+            if constexpr (std::is_same_v<typename Tokens::value_type, StringRef> && std::is_same_v<std::decay_t<decltype(str)>, StringView>) {
+                tokens.push_back(arena.keep(str));
+            } else {
+                tokens.push_back(str);
+            }
+        };
+        if constexpr (std::is_void_v<Pool>) {
+            renderTo(source, emit, Row {}, arena);
+        } else {
+            renderParallel(source, emit, arena, *pool);
+        }
+    }
+
+    // Render top level nodes, large arrays are rendered in chunks on pool into strings of arena
+    template<class Source, class Emit, class Pool>
+    void renderParallel(const Source& source, Emit&& emit, FormatArena& arena, Pool& pool) const {
+        const Row top;
+        for (const auto& node : _nodes) {
+            const auto* doc = std::get_if<2>(&node);
+            if (!doc) {
+                renderNode(node, source, emit, top, arena);
+                continue;
+            }
+            const auto rows = doc->loopRows(source, top);
+            const auto loopLength_ = rows.size();
+            Stats::count(&TemplateStats::loops);
+            Stats::count(&TemplateStats::loopIterations, loopLength_);
+            const auto chunkCount = pool.chunkCount(loopLength_);
+            if (chunkCount <= 1) {
+                for (size_t i = 0; i < loopLength_; ++i) {
+                    doc->renderTo(source, emit, Row { rows.begin + i, 1, &top }, arena);
+                }
+                continue;
+            }
+
+            std::vector<String*> chunks(chunkCount);
+            for (auto& chunk : chunks) {
+                chunk = &arena.string();
+            }
+            const auto* counters = active();
+            pool.run(chunkCount, [&](size_t c) {
+                Scope scope(counters);
+                // Chunks own their formatted values, they only need an arena while rendering
+                thread_local FormatArena chunkArena;
+                chunkArena.clear();
+                const auto end = loopLength_ * (c + 1) / chunkCount;
+                for (auto i = loopLength_ * c / chunkCount; i < end; ++i) {
+                    doc->renderTo(source, StringSink { *chunks[c] }, Row { rows.begin + i, 1, &top }, chunkArena);
+                }
+            });
+            for (const auto* chunk : chunks) {
+                if (!chunk->empty())
+                    emit(*chunk);
+            }
+        }
+    }
+
+    template<class Source>
+    String render(const Source& source, const Row& row) const {
+        Scope scope(*this, &TemplateStats::renders, &TemplateStats::renderNanoseconds);
+        String str;
+        str.reserve(renderedSize(source, row));
+        renderTo(source, StringSink { str }, row, local());
+        return str;
+    }
+
+    template<class Source>
+    size_t renderedSize(const Source& source, const Row& row) const {
+        size_t size = _textSize;
+        for (const auto& node : _nodes) {
+            switch (node.index()) {
+            case 1: {
+                const auto& var = std::get<1>(node);
+                if (const auto* data = find(source, var)) {
+                    const auto index = row.indexOf(*data);
+                    size += var.isEscaped ? escapedHtmlSize(*data, index) : valueSize(*data, index);
+                }
+                break;
+            }
+            case 2: {
+                const auto& doc = std::get<2>(node);
+                const auto rows = doc.loopRows(source, row);
+                for (size_t i = 0; i < rows.size(); ++i) {
+                    size += doc.renderedSize(source, Row { rows.begin + i, row.depth + 1, &row });
+                }
+                break;
+            }
+            default:
+                break;
+            }
+        }
+        return size;
+    }
+
+    // Render with data source, emit is called for each non-empty token (a StringView for data without
+    // string, see hasString(), numbers are formatted into arena)
+    template<class Source, class Emit>
+    void renderTo(const Source& source, Emit&& emit, const Row& row, FormatArena& arena) const {
+        for (const auto& node : _nodes) {
+            renderNode(node, source, emit, row, arena);
+        }
+    }
+
+    template<class Source, class Emit>
+    static void renderNode(const Node& node, const Source& source, Emit& emit, const Row& row, FormatArena& arena) {
+        switch (node.index()) {
+        case 0:
+            countToken(std::get<0>(node));
+            emit(std::get<0>(node));
+            break;
+        case 1: {
+            const auto& var = std::get<1>(node);
+            Stats::count(&TemplateStats::lookups);
+            if (const auto* data = find(source, var)) {
+                const auto index = row.indexOf(*data);
+                if (!hasString(*data)) {
+                    const auto str = arena.format(*data, index);
+                    if (str.empty())
+                        break;
+                    if (const auto* escaped = var.isEscaped ? escapeHtml(str, arena) : nullptr) {
+                        countToken(*escaped);
+                        emit(*escaped);
+                    } else {
+                        countToken(str);
+                        emit(str);
+                    }
+                    break;
+                }
+                const auto& str = valueAt(*data, index);
+                if (str.empty())
+                    break;
+                if (const auto* escaped = var.isEscaped ? escapeHtml(str, arena) : nullptr) {
+                    countToken(*escaped);
+                    emit(*escaped);
+                } else {
+                    countToken(str);
+                    emit(str);
+                }
+            } else {
+                Stats::count(&TemplateStats::missingKeys);
+            }
+            break;
+        }
+        case 2: {
+            const auto& doc = std::get<2>(node);
+            const auto rows = doc.loopRows(source, row);
+            Stats::count(&TemplateStats::loops);
+            Stats::count(&TemplateStats::loopIterations, rows.size());
+            for (size_t i = 0; i < rows.size(); ++i) {
+                doc.renderTo(source, emit, Row { rows.begin + i, row.depth + 1, &row }, arena);
+            }
+            break;
+        }
+        default:
+            break;
+        }
+    }
+
+    static void countToken(StringView str) {
+        Stats::count(&TemplateStats::tokens);
+        Stats::count(&TemplateStats::bytes, str.size());
+    }
+
+    // Obtain rows of this array block within row outer of the enclosing block, from the variables
+    // within it and its nested blocks
+    template<class Source>
+    Rows loopRows(const Source& source, const Row& outer) const {
+        Rows rows;
+        narrowRows(source, outer, rows, true);
+        return rows;
+    }
+
+    template<class Source>
+    void narrowRows(const Source& source, const Row& outer, Rows& rows, bool isDirect) const {
+        for (const auto& v : _nodes) {
+            if (const auto* pval = std::get_if<1>(&v)) {
+                Stats::count(&TemplateStats::lookups);
+                if (const auto* data = find(source, *pval)) {
+                    rows.narrow(*data, outer.depth, outer.index);
+                } else {
+                    // Key not found (within a nested block it only empties that block)
+                    Stats::count(&TemplateStats::missingKeys);
+                    if (isDirect) {
+                        rows.clear();
+                        return;
+                    }
+                }
+            } else if (const auto* doc = std::get_if<2>(&v)) {
+                doc->narrowRows(source, outer, rows, false);
+            }
+        }
+    }
+
+    std::pmr::vector<Node> _nodes;
+    size_t _lastNodeCount = 0;
+    // Accumulated size of text nodes (excluding nested templates)
+    size_t _textSize = 0;
+    // Source owned by a TemplateView (nodes of nested templates view into their parent's source)
+    std::shared_ptr<const String> _source;
+};
+
+// Keeps the rendered tokens of a bound template and only re-renders the spans of changed slots.
+// Each top level node owns one span of tokens (variables always one token, possibly empty), array
+// sections are only re-expanded when one of their slots changed.
+template<class T>
+class IncrementalRenderer {
+public:
+    using Tokens = typename T::Tokens;
+
+    // Template must be bound to the schema of the slots passed to update() and outlive the renderer
+    explicit IncrementalRenderer(const T& templ) :
+        _templ(templ),
+        _offsets(templ._nodes.size() + 1),
+        _isPending(templ._nodes.size()),
+        _arenas(templ._nodes.size()),
+        _reported(templ._nodes.size()) {
+        for (size_t i = 0; i < templ._nodes.size(); ++i) {
+            indexSlots(templ._nodes[i], i);
+        }
+    }
+
+    // Patch tokens of all nodes depending on changed slots and clear changes of slots.
+    // The first update renders everything.
+    const Tokens& update(TrackedSlots& trackedSlots) {
+        return update(trackedSlots, nullptr);
+    }
+
+    // Update and call delta with (node id, new value) of each node rendering differently than
+    // before, e.g. to push changes to clients holding the previous render. The first update with
+    // a delta reports all nodes.
+    template<class Delta>
+    const Tokens& update(TrackedSlots& trackedSlots, Delta&& delta) {
+        Stats::Scope scope(_templ, &TemplateStats::renders, &TemplateStats::renderNanoseconds);
+        const auto& slots = trackedSlots.slots();
+        if (!_isRendered) {
+            renderAll(slots);
+        } else {
+            for (const auto slot : trackedSlots.changes()) {
+                if (slot >= _nodesOfSlot.size()) {
+                    continue;
+                }
+                for (const auto i : _nodesOfSlot[slot]) {
+                    if (!_isPending[i]) {
+                        _isPending[i] = true;
+                        _pending.push_back(i);
+                    }
+                }
+            }
+            for (const auto i : _pending) {
+                renderNode(slots, i);
+                if constexpr (hasDelta<Delta>) {
+                    if (_isReported) {
+                        emitDelta(i, delta);
+                    }
+                }
+                _isPending[i] = false;
+            }
+            _lastPatchCount = _pending.size();
+            _pending.clear();
+        }
+        if constexpr (hasDelta<Delta>) {
+            if (!_isReported) {
+                for (size_t i = 0; i < _templ._nodes.size(); ++i) {
+                    emitDelta(i, delta);
+                }
+                _isReported = true;
+            }
+        }
+        trackedSlots.clearChanges();
+        return _tokens;
+    }
+
+    const Tokens& tokens() const {
+        return _tokens;
+    }
+
+    // Number of nodes re-rendered by last update
+    size_t lastPatchCount() const {
+        return _lastPatchCount;
+    }
+
+private:
+    using Node = typename std::decay_t<decltype(std::declval<const T&>()._nodes)>::value_type;
+
+    void indexSlots(const Node& node, size_t i) {
+        if (const auto* var = std::get_if<1>(&node)) {
+            if (var->slot == Schema::npos) {
+                return;
+            }
+            if (var->slot >= _nodesOfSlot.size()) {
+                _nodesOfSlot.resize(var->slot + 1);
+            }
+            auto& nodes = _nodesOfSlot[var->slot];
+            if (nodes.empty() || nodes.back() != i) {
+                nodes.push_back(i);
+            }
+        } else if (const auto* doc = std::get_if<2>(&node)) {
+            for (const auto& child : doc->_nodes) {
+                indexSlots(child, i);
+            }
+        }
+    }
+
+    template<class Delta>
+    static constexpr bool hasDelta = !std::is_null_pointer_v<std::decay_t<Delta>>;
+
+    void appendNode(size_t i, String& out) const {
+        for (auto j = _offsets[i]; j < _offsets[i+1]; ++j) {
+            out.append(view(_tokens[j]));
+        }
+    }
+
+    // Check if rendered value of node equals str
+    bool isNodeEqual(size_t i, StringView str) const {
+        for (auto j = _offsets[i]; j < _offsets[i+1]; ++j) {
+            const auto token = view(_tokens[j]);
+            if (str.substr(0, token.size()) != token) {
+                return false;
+            }
+            str.remove_prefix(token.size());
+        }
+        return str.empty();
+    }
 
-// This is our overload operator
-template<typename... Ts>
-struct Overload : Ts... {
-    using Ts::operator()...;
+    // Report node to delta unless it renders the bytes last reported. Marked slots may hold the
+    // same value (references are always marked). Reported bytes are kept as a copy, since tokens
+    // of the previous render may point into data replaced since.
+    template<class Delta>
+    void emitDelta(size_t i, Delta& delta) {
+        auto& reported = _reported[i];
+        if (_isReported && isNodeEqual(i, reported)) {
+            return;
+        }
+        reported.clear();
+        appendNode(i, reported);
+        delta(i, StringView(reported));
+    }
+
+    void renderAll(const DataSlots& slots) {
+        _tokens.clear();
+        for (size_t i = 0; i < _templ._nodes.size(); ++i) {
+            _offsets[i] = _tokens.size();
+            emitNode(slots, i, _tokens);
+        }
+        _offsets.back() = _tokens.size();
+        _lastPatchCount = _templ._nodes.size();
+        _isRendered = true;
+    }
+
+    void renderNode(const DataSlots& slots, size_t i) {
+        const auto& node = _templ._nodes[i];
+        const auto begin = _offsets[i];
+        const auto end = _offsets[i+1];
+        if (node.index() == 1) {
+            _arenas[i].clear();
+            _tokens[begin] = value(slots, std::get<1>(node), _arenas[i]);
+            return;
+        }
+
+        _scratch.clear();
+        emitNode(slots, i, _scratch);
+        if (_scratch.size() == end - begin) {
+            std::copy(_scratch.begin(), _scratch.end(), _tokens.begin() + begin);
+            return;
+        }
+
+        // Length of array changed: splice and shift spans of subsequent nodes
+        _tokens.erase(_tokens.begin() + begin, _tokens.begin() + end);
+        _tokens.insert(_tokens.begin() + begin, _scratch.begin(), _scratch.end());
+        const auto delta = _scratch.size() - (end - begin);
+        for (size_t j = i + 1; j < _offsets.size(); ++j) {
+            _offsets[j] += delta;
+        }
+    }
+
+    // Formatted columns of each node are kept in the node's own arena, until it is re-rendered
+    void emitNode(const DataSlots& slots, size_t i, Tokens& tokens) {
+        const auto& node = _templ._nodes[i];
+        auto& arena = _arenas[i];
+        arena.clear();
+        switch (node.index()) {
+        case 0:
+            tokens.push_back(std::get<0>(node));
+            break;
+        case 1:
+            tokens.push_back(value(slots, std::get<1>(node), arena));
+            break;
+        case 2: {
+            const auto& doc = std::get<2>(node);
+            const Row top;
+            const auto rows = doc.loopRows(slots, top);
+            for (size_t j = 0; j < rows.size(); ++j) {
+                doc.renderTo(slots, [&](const auto& str) { tokens.push_back(token(str, arena)); }, Row { rows.begin + j, 1, &top }, arena);
+            }
+            break;
+        }
+        default:
+            break;
+        }
+    }
+
+    static StringView view(const StringRef& token) {
+        return token.get();
+    }
+
+    static StringView view(StringView token) {
+        return token;
+    }
+
+    template<class Str>
+    static typename Tokens::value_type token(const Str& str, FormatArena& arena) {
+        if constexpr (std::is_same_v<typename Tokens::value_type, StringRef> && std::is_same_v<Str, StringView>) {
+            return arena.keep(str);
+        } else {
+            return str;
+        }
+    }
+
+    template<class Variable>
+    static typename Tokens::value_type value(const DataSlots& slots, const Variable& var, FormatArena& arena) {
+        static const String empty;
+        const auto* data = slots.find(var.slot);
+        if (!data) {
+            return empty;
+        }
+        // Escaped values are kept in the node's arena, so they are escaped once per change
+        if (!hasString(*data)) {
+            const auto str = arena.format(*data, 0);
+            if (const auto* escaped = var.isEscaped ? escapeHtml(str, arena) : nullptr) {
+                return *escaped;
+            }
+            return token(str, arena);
+        }
+        const auto& str = valueAt(*data, 0);
+        if (const auto* escaped = var.isEscaped ? escapeHtml(str, arena) : nullptr) {
+            return *escaped;
+        }
+        return str;
+    }
+
+    const T& _templ;
+    Tokens _tokens;
+    Tokens _scratch;
+    // Token offset of each top level node, plus end
+    std::vector<size_t> _offsets;
+    // Top level nodes depending on each slot
+    std::vector<std::vector<size_t>> _nodesOfSlot;
+    std::vector<size_t> _pending;
+    std::vector<bool> _isPending;
+    std::vector<FormatArena> _arenas;
+    // Bytes of each top level node last reported to delta
+    std::vector<String> _reported;
+    size_t _lastPatchCount = 0;
+    bool _isRendered = false;
+    bool _isReported = false;
 };
-template<class... Ts> Overload(Ts...) -> Overload<Ts...>;
 
-class Template {
+// Parses a template from chunks of input (e.g. a file, socket or flash page reader), without holding
+// the whole source in memory. Delimiters may be split across chunks. Only the current text node and
+// the current tag (or array block) are buffered. Results equal BasicTemplate::parse() of the whole input.
+template<class T>
+class StreamParser {
 public:
-    using Tokens = StringRefs;
+    static_assert(!T::isView, "tinja::StreamParser: views need the whole source, use Template");
 
-    Template(size_t reserveNodes = 0) :
-        _lastNodeCount(reserveNodes) {
+    // Parse into templ, replacing its nodes
+    explicit StreamParser(T& templ, ParseOptions options = {}) :
+        _templ(templ),
+        _options(options) {
+        _templ.enable();
+        _templ._nodes.clear();
+        _templ._textSize = 0;
+        _templ._source.reset();
     }
 
-    Template(const String& str, size_t reserveNodes = 0) :
-        _lastNodeCount(reserveNodes) {
-        parse(str);
+    void feed(StringView chunk) {
+        _buffer.append(chunk);
+        consume(false);
     }
 
-    // Parse input string to nodes
-    size_t parse(const String& str) {
-        _nodes.clear();
-        _nodes.reserve(_lastNodeCount);
-        State state = State::Text;
-        size_t pos = 0;
-        size_t nextPos = 0;
+    // Parse remaining input, returns node count
+    size_t finish() {
+        consume(true);
+        _buffer.clear();
+        _templ._lastNodeCount = _templ._nodes.size();
+        _templ.indexVariables();
+        return _templ._nodes.size();
+    }
 
-        while (pos != String::npos) {
-            switch (state) {
-            case State::Text:
-                state = parseText(str, pos, nextPos);
+    // Size of buffered input
+    size_t bufferedSize() const {
+        return _buffer.size() + _text.size();
+    }
+
+private:
+    // Same grammar as BasicTemplate::parseNodes(), but waits for more input where the end of input
+    // would decide
+    void consume(bool isEnd) {
+        size_t pos = 0;
+        while (!_isStopped && pos < _buffer.size()) {
+            const auto open = findDelimiter(_buffer, pos, '{', '{', '[');
+            if (open == String::npos) {
+                // A trailing '{' may start a delimiter
+                const auto end = (!isEnd && _buffer.back() == '{') ? _buffer.size() - 1 : _buffer.size();
+                _text.append(_buffer, pos, end - pos);
+                pos = end;
                 break;
-            case State::Variable:
-                state = parseUntil<1>(str, pos, "}}", nextPos);
+            }
+            if (open+3 >= _buffer.size()) {
+                // Too short for a tag (yet)
+                const auto end = isEnd ? _buffer.size() : open;
+                _text.append(_buffer, pos, end - pos);
+                pos = end;
                 break;
-            case State::Array:
-                state = parseUntil<2>(str, pos, "]}", nextPos);
+            }
+
+            const auto isArray = _buffer[open+1] == '[';
+            const auto close = isArray ? findArrayEnd(_buffer, open + 2) : _buffer.find("}}", open + 2);
+            _text.append(_buffer, pos, open - pos);
+            pos = open;
+            if (close == String::npos) {
+                if (isEnd) {
+                    // Unterminated tag ends parsing
+                    flushText();
+                    _isStopped = true;
+                }
                 break;
             }
-            pos = nextPos;
+            flushText();
+            if (isArray) {
+                _templ.template pushNode<2>(_buffer, open + 2, close, nullptr, _options);
+            } else {
+                _templ.template pushNode<1>(_buffer, open + 2, close, nullptr, _options);
+            }
+            pos = close + 2;
         }
-        _lastNodeCount = _nodes.size();
-        return _nodes.size();
-    };
+        _buffer.erase(0, pos);
+        if (isEnd) {
+            flushText();
+        }
+    }
 
-    void renderTo(const DataMap& dataMap, Tokens& tokens) const {
-        tokens.clear();
-        renderTo(dataMap, tokens, 0);
+    void flushText() {
+        if (!_text.empty()) {
+            _templ.template pushNode<0>(_text, 0, _text.size(), nullptr, _options);
+            _text.clear();
+        }
     }
 
-private:
-    using Text = String;
-    using Variable = String;
-    using Node = std::variant<Text, Variable, Template>;
+    T& _templ;
+    const ParseOptions _options;
+    // Unconsumed input, starting with an incomplete tag
+    String _buffer;
+    // Text node being collected
+    String _text;
+    bool _isStopped = false;
+};
 
-    enum class State {
-        Text,
-        Variable,
-        Array
+// Append delta record of a node: node id and value size as LEB128 varints, followed by the value
+inline void appendDelta(String& out, size_t node, StringView value) {
+    const auto appendVarint = [&](size_t v) {
+        for (; v >= 0x80; v >>= 7) {
+            out.push_back(static_cast<char>(v | 0x80));
+        }
+        out.push_back(static_cast<char>(v));
     };
+    appendVarint(node);
+    appendVarint(value.size());
+    out.append(value);
+}
 
-    State parseText(const String& str, size_t startPos, size_t& nextPos) {
-        nextPos = str.find("{", nextPos);
-        if (nextPos != str.npos && nextPos+3 < str.size()) {
-            switch (str.at(nextPos+1)) {
-            case '{':
-                pushNode<0>(str, startPos, nextPos);
-                nextPos += 2;
-                return State::Variable;
-            case '[':
-                pushNode<0>(str, startPos, nextPos);
-                nextPos += 2;
-                return State::Array;
-            default:
-                parseText(str, startPos, ++nextPos);
+// Read delta record at pos, returns false if in holds no complete record at pos (pos is unchanged)
+inline bool readDelta(StringView in, size_t& pos, size_t& node, StringView& value) {
+    auto p = pos;
+    const auto readVarint = [&](size_t& v) {
+        v = 0;
+        for (size_t shift = 0; p < in.size() && shift < 64; shift += 7) {
+            const auto byte = static_cast<uint8_t>(in[p++]);
+            v |= static_cast<size_t>(byte & 0x7f) << shift;
+            if (!(byte & 0x80)) {
+                return true;
             }
         }
-        nextPos = String::npos;
-        pushNode<0>(str, startPos, nextPos);
-        return State::Text;
+        return false;
+    };
+    size_t size = 0;
+    if (!readVarint(node) || !readVarint(size) || in.size() - p < size) {
+        return false;
     }
+    value = in.substr(p, size);
+    pos = p + size;
+    return true;
+}
 
-    template<size_t S>
-    State parseUntil(const String& str, size_t startPos, const String& until, size_t& nextPos) {
-        nextPos = str.find(until, startPos);
-        if (nextPos != str.npos) {
-            pushNode<S>(str, startPos, nextPos);
+// Flat, compiled representation of a template: one contiguous array of opcodes plus one text arena,
+// executed by a non-recursive interpreter.
+class Program {
+public:
+    using Tokens = StringViews;
+
+    enum class OpCode : uint8_t {
+        Text,       // a: offset into text arena, b: size
+        Variable,   // a: offset of name in text arena, b: size of name, slot: bound slot
+        LoopBegin,  // a: index of matching LoopEnd
+        LoopEnd     // a: index of matching LoopBegin
+    };
+
+    // Flags of Variable ops
+    static constexpr uint8_t escapeHtml = 1;
+
+    struct Op {
+        OpCode code;
+        uint8_t flags;
+        uint32_t a;
+        uint32_t b;
+        uint32_t slot;
+    };
+
+    // Contiguous view of ops
+    struct Ops {
+        const Op* data;
+        size_t count;
+
+        const Op* begin() const { return data; }
+        const Op* end() const { return data + count; }
+        size_t size() const { return count; }
+        const Op& operator[](size_t i) const { return data[i]; }
+    };
+
+    // Maximum nesting depth of array blocks
+    static constexpr size_t maxDepth = 16;
+    static constexpr uint32_t nslot = std::numeric_limits<uint32_t>::max();
+
+    // Binary image: header, ops (4 byte aligned, in memory layout) and text, little endian
+    static constexpr uint16_t imageVersion = 2;
+
+    struct ImageHeader {
+        char magic[4];      // "TNJA"
+        uint16_t version;
+        uint16_t opSize;
+        uint32_t byteOrder; // 0x01020304 as written by the producer
+        uint32_t opCount;
+        uint32_t textSize;
+    };
+
+    Program() = default;
+
+    // Compile template, slots are taken over from a bound template
+    template<class TextT>
+    explicit Program(const BasicTemplate<TextT>& templ) {
+        compile(templ, 0);
+    }
+
+    // View a binary image from serialize(), e.g. mmap'ed or a flash resident array (alignas(4)).
+    // Nothing is copied, the image must outlive the program. Throws std::invalid_argument if the
+    // image is invalid.
+    static Program view(const void* image, size_t size) {
+        const auto* bytes = static_cast<const char*>(image);
+        ImageHeader header;
+        if (size < sizeof(header)) {
+            throw std::invalid_argument("tinja::Program: image too small");
+        }
+        std::memcpy(&header, bytes, sizeof(header));
+        if (std::memcmp(header.magic, "TNJA", 4) != 0 || header.version != imageVersion ||
+            header.opSize != sizeof(Op) || header.byteOrder != 0x01020304) {
+            throw std::invalid_argument("tinja::Program: incompatible image");
         }
-        nextPos = (nextPos != str.npos && nextPos+until.size() < str.size()) ? nextPos+until.size() : String::npos;
-        return State::Text;
+        const auto* ops = bytes + sizeof(header);
+        if (reinterpret_cast<uintptr_t>(ops) % alignof(Op) != 0) {
+            throw std::invalid_argument("tinja::Program: misaligned image");
+        }
+        if (size != sizeof(header) + uint64_t(header.opCount) * sizeof(Op) + header.textSize) {
+            throw std::invalid_argument("tinja::Program: image size mismatch");
+        }
+
+        Program program;
+        program._image = { reinterpret_cast<const Op*>(ops), header.opCount };
+        program._imageText = StringView(ops + header.opCount * sizeof(Op), header.textSize);
+        program.validate();
+        return program;
     }
 
-    template<size_t S>
-    void pushNode(const String& str, size_t from, size_t to) {
-        if (from >= to || str.size() <= from)
-            return;
-        _nodes.emplace_back(Node { std::in_place_index<S>, str.substr(from, to-from) });
+    // Serialize to a binary image, which view() loads without parsing
+    String serialize() const {
+        const auto ops_ = ops();
+        const auto text_ = text();
+        ImageHeader header { { 'T', 'N', 'J', 'A' }, imageVersion, sizeof(Op), 0x01020304,
+                             static_cast<uint32_t>(ops_.size()), static_cast<uint32_t>(text_.size()) };
+        String image(sizeof(header) + ops_.size() * sizeof(Op) + text_.size(), '\0');
+        auto* out = image.data();
+        std::memcpy(out, &header, sizeof(header));
+        out += sizeof(header);
+        // Field by field, so padding is zeroed
+        for (const auto& op : ops_) {
+            out[0] = static_cast<char>(op.code);
+            out[offsetof(Op, flags)] = static_cast<char>(op.flags);
+            std::memcpy(out + offsetof(Op, a), &op.a, sizeof(op.a));
+            std::memcpy(out + offsetof(Op, b), &op.b, sizeof(op.b));
+            std::memcpy(out + offsetof(Op, slot), &op.slot, sizeof(op.slot));
+            out += sizeof(Op);
+        }
+        std::memcpy(out, text_.data(), text_.size());
+        return image;
     }
 
-    // Render tokens with data map
-    void renderTo(const DataMap& dataMap, Tokens& tokens, size_t index) const {
-        for (const auto& node : _nodes) {
+    // Resolve variables to slots of schema (adds unknown keys to schema). Copies a viewed image.
+    void bind(Schema& schema) {
+        if (_image.data) {
+            _ops.assign(_image.begin(), _image.end());
+            _text.assign(_imageText);
+            _image = {};
+            _imageText = {};
+        }
+        for (auto& op : _ops) {
+            if (op.code == OpCode::Variable) {
+                op.slot = static_cast<uint32_t>(schema.slot(String(name(op))));
+            }
+        }
+    }
+
+    // Render to tokens. Tokens of formatted columns are valid until the next render on this thread.
+    void renderTo(const DataMap& dataMap, Tokens& tokens) const {
+        tokens.clear();
+        run(dataMap, [&](StringView str) { tokens.push_back(str); });
+    }
+
+    // Render from slots, program must be bound to the schema of dataSlots
+    void renderTo(const DataSlots& dataSlots, Tokens& tokens) const {
+        tokens.clear();
+        run(dataSlots, [&](StringView str) { tokens.push_back(str); });
+    }
+
+    // Render directly into a sink, which is called with a StringView for each non-empty token
+    template<class Sink, class = std::enable_if_t<std::is_invocable_v<Sink&, StringView>>>
+    void renderTo(const DataMap& dataMap, Sink&& sink) const {
+        run(dataMap, sink);
+    }
+
+    template<class Sink, class = std::enable_if_t<std::is_invocable_v<Sink&, StringView>>>
+    void renderTo(const DataSlots& dataSlots, Sink&& sink) const {
+        run(dataSlots, sink);
+    }
+
+    Ops ops() const {
+        return _image.data ? _image : Ops { _ops.data(), _ops.size() };
+    }
+
+    // Text arena holding text and variable names
+    StringView text() const {
+        return _image.data ? _imageText : StringView(_text);
+    }
+
+private:
+    struct Frame {
+        size_t begin;
+        size_t index;   // index of enclosing loop
+        size_t end;     // end of rows
+    };
+
+    template<class TextT>
+    void compile(const BasicTemplate<TextT>& templ, size_t depth) {
+        if (depth > maxDepth) {
+            throw std::length_error("tinja::Program: array blocks nested too deep");
+        }
+        for (const auto& node : templ._nodes) {
             switch (node.index()) {
             case 0:
-                tokens.push_back(std::get<0>(node));
+                _ops.push_back({ OpCode::Text, 0, append(std::get<0>(node)), static_cast<uint32_t>(std::get<0>(node).size()), nslot });
                 break;
             case 1: {
                 const auto& var = std::get<1>(node);
-                if (dataMap.count(var)) {
-                    std::visit(Overload {
-                        // Render regular variable
-                        [&](const String& str) {
-                            if (!str.empty())
-                                tokens.push_back(str);
-                        },
-                        // Render array variable
-                        [&](const Strings& v) {
-                            if (!v.at(index).empty())
-                                tokens.push_back(v.at(index));
-                        },
-                        [&](const StringRefs& v) {
-                            if (!v.at(index).get().empty())
-                                tokens.push_back(v.at(index));
-                        }
-                    }, dataMap.at(var));
-                }
+                const auto slot = var.slot == Schema::npos ? nslot : static_cast<uint32_t>(var.slot);
+                _ops.push_back({ OpCode::Variable, var.isEscaped ? escapeHtml : uint8_t(0), append(var.name), static_cast<uint32_t>(var.name.size()), slot });
                 break;
             }
             case 2: {
-                const auto& doc = std::get<2>(node);
-                const auto loopLength_ = doc.loopLength(dataMap);
-                for (size_t i = 0; i < loopLength_; ++i) {
-                    doc.renderTo(dataMap, tokens, i);
-                }
+                const auto begin = _ops.size();
+                _ops.push_back({ OpCode::LoopBegin, 0, 0, 0, nslot });
+                compile(std::get<2>(node), depth + 1);
+                _ops[begin].a = static_cast<uint32_t>(_ops.size());
+                _ops.push_back({ OpCode::LoopEnd, 0, static_cast<uint32_t>(begin), 0, nslot });
                 break;
             }
             default:
@@ -158,35 +2539,384 @@ private:
         }
     }
 
-    // Obtain loop length for vectorized variables in array
-    size_t loopLength(const DataMap& dataMap) const {
-        size_t length = std::numeric_limits<size_t>::max();
-        for (const auto& v : _nodes) {
-            if (const auto* pval = std::get_if<1>(&v)) {
-                if (dataMap.count(*pval)) {
-                    std::visit(Overload {
-                        // Regular variables are ignored for loop length
-                        [](const String&) {},
-                        // Vectorized variable
-                        [&](const Strings& v) {
-                            length = std::min(length, v.size());
-                        },
-                        [&](const StringRefs& v) {
-                            length = std::min(length, v.size());
-                        },
-                    }, dataMap.at(*pval));
-                } else {
+    uint32_t append(StringView str) {
+        const auto offset = static_cast<uint32_t>(_text.size());
+        _text.append(str);
+        return offset;
+    }
+
+    StringView name(const Op& op) const {
+        return text().substr(op.a, op.b);
+    }
+
+    // Check ranges and loop structure of a viewed image
+    void validate() const {
+        const auto ops_ = ops();
+        const auto textSize = text().size();
+        std::array<size_t, maxDepth> loops;
+        size_t depth = 0;
+        for (size_t pc = 0; pc < ops_.size(); ++pc) {
+            const auto& op = ops_[pc];
+            switch (op.code) {
+            case OpCode::Text:
+            case OpCode::Variable:
+                if (op.flags & ~escapeHtml) {
+                    throw std::invalid_argument("tinja::Program: invalid op");
+                }
+                if (uint64_t(op.a) + op.b > textSize) {
+                    throw std::invalid_argument("tinja::Program: text out of range");
+                }
+                break;
+            case OpCode::LoopBegin:
+                if (depth == maxDepth || op.a <= pc || op.a >= ops_.size()) {
+                    throw std::invalid_argument("tinja::Program: invalid loop");
+                }
+                loops[depth++] = pc;
+                break;
+            case OpCode::LoopEnd:
+                if (depth == 0 || op.a != loops[depth-1] || ops_[op.a].a != pc) {
+                    throw std::invalid_argument("tinja::Program: invalid loop");
+                }
+                --depth;
+                break;
+            default:
+                throw std::invalid_argument("tinja::Program: invalid op");
+            }
+        }
+        if (depth != 0) {
+            throw std::invalid_argument("tinja::Program: invalid loop");
+        }
+    }
+
+    const Data* find(const DataMap& dataMap, const Op& op) const {
+        return findData(dataMap, name(op));
+    }
+
+    const Data* find(const DataSlots& dataSlots, const Op& op) const {
+        return dataSlots.find(op.slot);
+    }
+
+    // Obtain rows of loop starting at begin within row parent of the enclosing loop at depth, from
+    // the variables within it and its nested loops
+    template<class Source>
+    Rows loopRows(const Source& source, size_t begin, size_t depth, size_t parent) const {
+        Rows rows;
+        const auto ops_ = ops();
+        const auto end = ops_[begin].a;
+        size_t nesting = 0;
+        for (size_t pc = begin + 1; pc < end; ++pc) {
+            const auto& op = ops_[pc];
+            if (op.code == OpCode::LoopBegin) {
+                ++nesting;
+            } else if (op.code == OpCode::LoopEnd) {
+                --nesting;
+            } else if (op.code == OpCode::Variable) {
+                if (const auto* data = find(source, op)) {
+                    rows.narrow(*data, depth, parent);
+                } else if (nesting == 0) {
                     // Key not found
-                    length = 0;
+                    rows.clear();
                     break;
                 }
             }
         }
-        return length == std::numeric_limits<size_t>::max() ? 1 : length;
+        return rows;
     }
 
-    std::vector<Node> _nodes;
-    size_t _lastNodeCount = 0;
+    template<class Source, class Emit>
+    void run(const Source& source, Emit&& emit) const {
+        std::array<Frame, maxDepth> frames;
+        size_t depth = 0;
+        // Index of innermost loop, kept out of frames for the hot path
+        size_t index = 0;
+        auto& arena = FormatArena::local();
+        arena.clear();
+        const auto* text = this->text().data();
+        const auto ops_ = this->ops();
+        const auto* ops = ops_.data;
+        const auto count = ops_.count;
+        for (size_t pc = 0; pc < count; ++pc) {
+            const auto& op = ops[pc];
+            switch (op.code) {
+            case OpCode::Text:
+                emit(StringView(text + op.a, op.b));
+                break;
+            case OpCode::Variable:
+                if (const auto* data = find(source, op)) {
+                    // Arrays of enclosing loops are indexed by their frame
+                    const auto levels = levelsOf(*data);
+                    const auto row = levels != 0 && levels < depth ? frames[levels].index : index;
+                    const auto str = hasString(*data) ? StringView(valueAt(*data, row)) : arena.format(*data, row);
+                    if (str.empty())
+                        break;
+                    if (const auto* escaped = (op.flags & escapeHtml) ? tinja::escapeHtml(str, arena) : nullptr)
+                        emit(StringView(*escaped));
+                    else
+                        emit(str);
+                }
+                break;
+            case OpCode::LoopBegin: {
+                const auto rows = loopRows(source, pc, depth, index);
+                if (rows.size() == 0) {
+                    pc = op.a;
+                } else {
+                    frames[depth++] = { pc, index, rows.begin + rows.size() };
+                    index = rows.begin;
+                }
+                break;
+            }
+            case OpCode::LoopEnd: {
+                const auto& frame = frames[depth-1];
+                if (++index < frame.end) {
+                    pc = frame.begin;
+                } else {
+                    // Restore index of enclosing loop
+                    index = frame.index;
+                    --depth;
+                }
+                break;
+            }
+            }
+        }
+    }
+
+    std::vector<Op> _ops;
+    String _text;
+    // Viewed image (instead of _ops and _text)
+    Ops _image = {};
+    StringView _imageText;
+};
+
+// Template parsed at compile time. S must point to a constexpr char array with static storage:
+//   static constexpr char page[] = "Hello {{name}}!";
+//   tinja::StaticTemplate<page> templ;
+// The nodes are encoded in the type, rendering unrolls into straight-line emits.
+template<const char* S>
+class StaticTemplate {
+public:
+    using Tokens = StringViews;
+    using OpCode = Program::OpCode;
+
+    struct Op {
+        OpCode code;
+        size_t a;       // offset of text/name in S, index of LoopEnd for LoopBegin
+        size_t b;       // size of text/name
+        size_t parent;  // index of enclosing LoopBegin, npos at top level
+        size_t var;     // ordinal of variable
+    };
+
+    static constexpr StringView source = StringView(S);
+
+    // Resolve variables to slots of schema (adds unknown keys to schema)
+    void bind(Schema& schema) {
+        bindOps(schema, std::make_index_sequence<opCount>());
+    }
+
+    // Render to tokens. Tokens of formatted columns are valid until the next render on this thread.
+    void renderTo(const DataMap& dataMap, Tokens& tokens) const {
+        tokens.clear();
+        FormatArena::local().clear();
+        renderScope<npos>(dataMap, [&](StringView str) { tokens.push_back(str); }, Row {}, std::make_index_sequence<opCount>());
+    }
+
+    void renderTo(const DataSlots& dataSlots, Tokens& tokens) const {
+        tokens.clear();
+        FormatArena::local().clear();
+        renderScope<npos>(dataSlots, [&](StringView str) { tokens.push_back(str); }, Row {}, std::make_index_sequence<opCount>());
+    }
+
+    // Render directly into a sink, which is called with a StringView for each non-empty token
+    template<class Sink, class = std::enable_if_t<std::is_invocable_v<Sink&, StringView>>>
+    void renderTo(const DataMap& dataMap, Sink&& sink) const {
+        FormatArena::local().clear();
+        renderScope<npos>(dataMap, sink, Row {}, std::make_index_sequence<opCount>());
+    }
+
+    template<class Sink, class = std::enable_if_t<std::is_invocable_v<Sink&, StringView>>>
+    void renderTo(const DataSlots& dataSlots, Sink&& sink) const {
+        FormatArena::local().clear();
+        renderScope<npos>(dataSlots, sink, Row {}, std::make_index_sequence<opCount>());
+    }
+
+private:
+    static constexpr size_t npos = String::npos;
+
+    enum class State {
+        Text,
+        Variable,
+        Array
+    };
+
+    // Parse [from, to) of str into ops (only counts if ops is null), returns new op count.
+    // Same grammar as BasicTemplate::parse.
+    static constexpr size_t compile(StringView str, size_t from, size_t to, size_t parent, Op* ops, size_t count, size_t& vars) {
+        const auto sub = str.substr(0, to);
+        State state = State::Text;
+        size_t pos = from;
+        while (pos != npos) {
+            switch (state) {
+            case State::Text: {
+                auto next = sub.find('{', pos);
+                while (next != npos && next+3 < to && sub[next+1] != '{' && sub[next+1] != '[') {
+                    next = sub.find('{', next+1);
+                }
+                const auto isTag = next != npos && next+3 < to;
+                const auto textEnd = isTag ? next : to;
+                if (pos < textEnd) {
+                    if (ops) ops[count] = { OpCode::Text, pos, textEnd - pos, parent, 0 };
+                    ++count;
+                }
+                if (isTag) {
+                    state = sub[next+1] == '{' ? State::Variable : State::Array;
+                    pos = next + 2;
+                } else {
+                    pos = npos;
+                }
+                break;
+            }
+            case State::Variable: {
+                const auto next = sub.find("}}", pos);
+                if (next != npos && pos < next) {
+                    if (ops) ops[count] = { OpCode::Variable, pos, next - pos, parent, vars };
+                    ++count;
+                    ++vars;
+                }
+                state = State::Text;
+                pos = (next != npos && next+2 < to) ? next+2 : npos;
+                break;
+            }
+            case State::Array: {
+                const auto next = findArrayEnd(sub, pos);
+                if (next != npos && pos < next) {
+                    const auto begin = count;
+                    ++count;
+                    count = compile(str, pos, next, begin, ops, count, vars);
+                    if (ops) {
+                        ops[begin] = { OpCode::LoopBegin, count, 0, parent, 0 };
+                        ops[count] = { OpCode::LoopEnd, begin, 0, begin, 0 };
+                    }
+                    ++count;
+                }
+                state = State::Text;
+                pos = (next != npos && next+2 < to) ? next+2 : npos;
+                break;
+            }
+            }
+        }
+        return count;
+    }
+
+    static constexpr size_t countOps() {
+        size_t vars = 0;
+        return compile(source, 0, source.size(), npos, nullptr, 0, vars);
+    }
+
+    static constexpr size_t countVars() {
+        size_t vars = 0;
+        compile(source, 0, source.size(), npos, nullptr, 0, vars);
+        return vars;
+    }
+
+    static constexpr size_t opCount = countOps();
+    static constexpr size_t varCount = countVars();
+
+    static constexpr std::array<Op, opCount> compileOps() {
+        std::array<Op, opCount> ops {};
+        size_t vars = 0;
+        compile(source, 0, source.size(), npos, ops.data(), 0, vars);
+        return ops;
+    }
+
+    static constexpr std::array<Op, opCount> ops = compileOps();
+
+    template<size_t... I>
+    void bindOps(Schema& schema, std::index_sequence<I...>) {
+        ((ops[I].code == OpCode::Variable ? void(_slots[ops[I].var] = schema.slot(String(name<I>()))) : void()), ...);
+    }
+
+    template<size_t I>
+    static constexpr StringView name() {
+        return StringView(S + ops[I].a, ops[I].b);
+    }
+
+    template<size_t I>
+    const Data* find(const DataMap& dataMap) const {
+        // One key string per variable, built on first use
+        static const String key(name<I>());
+        const auto it = dataMap.find(key);
+        return it == dataMap.end() ? nullptr : &it->second;
+    }
+
+    template<size_t I>
+    const Data* find(const DataSlots& dataSlots) const {
+        return dataSlots.find(_slots[ops[I].var]);
+    }
+
+    // Render all ops directly within loop Parent
+    template<size_t Parent, class Source, class Emit, size_t... I>
+    void renderScope(const Source& source, Emit&& emit, const Row& row, std::index_sequence<I...> seq) const {
+        (renderOp<I, Parent>(source, emit, row, seq), ...);
+    }
+
+    template<size_t I, size_t Parent, class Source, class Emit, class Seq>
+    void renderOp(const Source& source, Emit& emit, const Row& row, Seq seq) const {
+        constexpr auto op = ops[I];
+        if constexpr (op.parent != Parent) {
+            return;
+        } else if constexpr (op.code == OpCode::Text) {
+            emit(name<I>());
+        } else if constexpr (op.code == OpCode::Variable) {
+            if (const auto* data = find<I>(source)) {
+                const auto index = row.indexOf(*data);
+                if (!hasString(*data)) {
+                    const auto str = FormatArena::local().format(*data, index);
+                    if (!str.empty())
+                        emit(str);
+                    return;
+                }
+                const auto& str = valueAt(*data, index);
+                if (!str.empty())
+                    emit(StringView(str));
+            }
+        } else if constexpr (op.code == OpCode::LoopBegin) {
+            const auto rows = loopRows<I>(source, row, seq);
+            for (size_t i = 0; i < rows.size(); ++i) {
+                renderScope<I>(source, emit, Row { rows.begin + i, row.depth + 1, &row }, seq);
+            }
+        }
+    }
+
+    // Obtain rows of loop L within row outer of the enclosing loop, from the variables within it
+    // and its nested loops
+    template<size_t L, class Source, size_t... I>
+    Rows loopRows(const Source& source, const Row& outer, std::index_sequence<I...>) const {
+        Rows rows;
+        bool found = true;
+        ([&] {
+            if constexpr (L < I && I < ops[L].a && ops[I].code == OpCode::Variable) {
+                if (const auto* data = find<I>(source)) {
+                    rows.narrow(*data, outer.depth, outer.index);
+                } else if (ops[I].parent == L) {
+                    // Key not found
+                    found = false;
+                }
+            }
+        }(), ...);
+        if (!found) {
+            rows.clear();
+        }
+        return rows;
+    }
+
+    std::array<size_t, varCount> _slots = filledSlots();
+
+    static constexpr std::array<size_t, varCount> filledSlots() {
+        std::array<size_t, varCount> slots {};
+        for (auto& slot : slots) {
+            slot = Schema::npos;
+        }
+        return slots;
+    }
 };
 
 } // namespace tinja
@@ -0,0 +1,169 @@
+#pragma once
+
+#include "tinja.hpp"
+
+#include <zlib.h>
+
+namespace tinja {
+
+// Renders a program as gzip member. Text ops are deflated once at construction (each as byte
+// aligned, non-final deflate blocks), per render only the dynamic bytes in between are compressed
+// and stitched with them into one deflate stream. The CRC of static segments is combined, not
+// recomputed.
+class GzipProgram {
+public:
+    // level: compression level of text ops. Runs of dynamic bytes shorter than minCompressSize are
+    // written as stored blocks, longer ones are compressed fast.
+    explicit GzipProgram(Program program, int level = Z_BEST_COMPRESSION, size_t minCompressSize = 256) :
+        _program(std::move(program)),
+        _minCompressSize(minCompressSize) {
+        z_stream stream {};
+        if (deflateInit2(&stream, level, Z_DEFLATED, -MAX_WBITS, 9, Z_DEFAULT_STRATEGY) != Z_OK) {
+            throw std::runtime_error("tinja::GzipProgram: deflateInit2 failed");
+        }
+        const auto text = _program.text();
+        for (const auto& op : _program.ops()) {
+            if (op.code != Program::OpCode::Text) {
+                continue;
+            }
+            const auto str = text.substr(op.a, op.b);
+            Segment segment;
+            segment.offset = static_cast<uint32_t>(_deflated.size());
+            deflateReset(&stream);
+            deflateSyncFlush(stream, str, _deflated);
+            segment.size = static_cast<uint32_t>(_deflated.size() - segment.offset);
+            segment.crc = crc32(0, reinterpret_cast<const Bytef*>(str.data()), static_cast<uInt>(str.size()));
+            segment.length = str.size();
+            _segments.emplace(op.a, segment);
+        }
+        deflateEnd(&stream);
+    }
+
+    const Program& program() const {
+        return _program;
+    }
+
+    // Size of all deflated text ops
+    size_t deflatedSize() const {
+        return _deflated.size();
+    }
+
+    // Append gzip member of rendered source (DataMap or DataSlots) to out
+    template<class Source>
+    void renderTo(const Source& source, String& out) const {
+        auto& run = local();
+        run.bytes.clear();
+        out.append(header, sizeof(header));
+        uLong crc = 0;
+        uLong length = 0;
+        const auto* text = _program.text().data();
+        const auto textSize = _program.text().size();
+        _program.renderTo(source, [&](StringView str) {
+            // Text tokens are views into the program's text arena
+            const auto it = (str.data() >= text && str.data() < text + textSize) ?
+                        _segments.find(static_cast<uint32_t>(str.data() - text)) : _segments.end();
+            if (it == _segments.end() || it->second.length != str.size()) {
+                run.bytes.append(str);
+                return;
+            }
+            flush(run, crc, length, out);
+            const auto& segment = it->second;
+            out.append(_deflated, segment.offset, segment.size);
+            crc = crc32_combine(crc, segment.crc, static_cast<z_off_t>(segment.length));
+            length += segment.length;
+        });
+        flush(run, crc, length, out);
+
+        // Empty final block (fixed Huffman codes) and trailer
+        const char trailer[] = {
+            0x03, 0x00,
+            char(crc), char(crc >> 8), char(crc >> 16), char(crc >> 24),
+            char(length), char(length >> 8), char(length >> 16), char(length >> 24) };
+        out.append(trailer, sizeof(trailer));
+    }
+
+    template<class Source>
+    String render(const Source& source) const {
+        String out;
+        renderTo(source, out);
+        return out;
+    }
+
+private:
+    struct Segment {
+        uint32_t offset;    // into _deflated
+        uint32_t size;
+        uLong crc;
+        size_t length;      // uncompressed
+    };
+
+    // Per thread compressor of dynamic bytes
+    struct Run {
+        Run() {
+            // Small hash table, it is cleared for every run
+            if (deflateInit2(&stream, Z_BEST_SPEED, Z_DEFLATED, -MAX_WBITS, 4, Z_DEFAULT_STRATEGY) != Z_OK) {
+                throw std::runtime_error("tinja::GzipProgram: deflateInit2 failed");
+            }
+        }
+        ~Run() {
+            deflateEnd(&stream);
+        }
+        Run(const Run&) = delete;
+        Run& operator=(const Run&) = delete;
+
+        z_stream stream {};
+        String bytes;
+    };
+
+    static constexpr char header[10] = { 0x1f, char(0x8b), 0x08, 0, 0, 0, 0, 0, 0, char(0xff) };
+
+    static Run& local() {
+        thread_local Run run;
+        return run;
+    }
+
+    // Deflate str with a sync flush, which ends byte aligned and without final block
+    static void deflateSyncFlush(z_stream& stream, StringView str, String& out) {
+        stream.next_in = reinterpret_cast<Bytef*>(const_cast<char*>(str.data()));
+        stream.avail_in = static_cast<uInt>(str.size());
+        do {
+            const auto pos = out.size();
+            const auto avail = deflateBound(&stream, stream.avail_in) + 16;
+            out.resize(pos + avail);
+            stream.next_out = reinterpret_cast<Bytef*>(out.data() + pos);
+            stream.avail_out = static_cast<uInt>(avail);
+            deflate(&stream, Z_SYNC_FLUSH);
+            out.resize(pos + avail - stream.avail_out);
+        } while (stream.avail_in > 0 || stream.avail_out == 0);
+    }
+
+    // Write pending dynamic bytes as stored or compressed blocks
+    void flush(Run& run, uLong& crc, uLong& length, String& out) const {
+        const auto& bytes = run.bytes;
+        if (bytes.empty()) {
+            return;
+        }
+        crc = crc32(crc, reinterpret_cast<const Bytef*>(bytes.data()), static_cast<uInt>(bytes.size()));
+        length += bytes.size();
+        if (bytes.size() >= _minCompressSize) {
+            deflateReset(&run.stream);
+            deflateSyncFlush(run.stream, bytes, out);
+        } else {
+            for (size_t pos = 0; pos < bytes.size(); pos += 0xffff) {
+                const auto size = std::min<size_t>(bytes.size() - pos, 0xffff);
+                const char block[] = { 0x00, char(size), char(size >> 8), char(~size), char(~size >> 8) };
+                out.append(block, sizeof(block));
+                out.append(bytes, pos, size);
+            }
+        }
+        run.bytes.clear();
+    }
+
+    Program _program;
+    size_t _minCompressSize;
+    // Deflated text ops, by offset of their text
+    std::unordered_map<uint32_t, Segment> _segments;
+    String _deflated;
+};
+
+} // namespace tinja
@@ -0,0 +1,53 @@
+#pragma once
+
+#include "tinja.hpp"
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace tinja {
+
+// Read only memory mapping of a file, e.g. a program image
+class MappedFile {
+public:
+    // Throws std::runtime_error if the file cannot be mapped
+    explicit MappedFile(const char* path) {
+        const auto fd = ::open(path, O_RDONLY);
+        if (fd < 0) {
+            throw std::runtime_error("tinja::MappedFile: cannot open file");
+        }
+        struct stat st;
+        if (::fstat(fd, &st) == 0 && st.st_size > 0) {
+            _size = static_cast<size_t>(st.st_size);
+            _data = ::mmap(nullptr, _size, PROT_READ, MAP_PRIVATE, fd, 0);
+        }
+        ::close(fd);
+        if (_data == MAP_FAILED || !_data) {
+            _data = nullptr;
+            throw std::runtime_error("tinja::MappedFile: cannot map file");
+        }
+    }
+
+    ~MappedFile() {
+        ::munmap(_data, _size);
+    }
+
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+
+    const void* data() const {
+        return _data;
+    }
+
+    size_t size() const {
+        return _size;
+    }
+
+private:
+    void* _data = nullptr;
+    size_t _size = 0;
+};
+
+} // namespace tinja
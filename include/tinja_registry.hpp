@@ -0,0 +1,193 @@
+#pragma once
+
+#include "tinja.hpp"
+
+#include <memory>
+#include <unordered_set>
+
+namespace tinja {
+
+// Registry of named templates, which can include each other as partials ({{>name}}).
+// Parse results are cached by content (looked up by hash): unchanged templates are never parsed
+// again and changing a template only invalidates the templates including it. Not thread-safe, but
+// the returned templates are immutable and can be shared (e.g. through SharedTemplate).
+class TemplateRegistry {
+public:
+    using Ptr = std::shared_ptr<const Template>;
+
+    // Add or update template, returns false if content is unchanged
+    bool set(const String& name, String source) {
+        const auto hash = contentHash(source);
+        const auto [it, isNew] = _entries.try_emplace(name);
+        auto& entry = it->second;
+        if (!isNew && entry.hash == hash && entry.source == source) {
+            return false;
+        }
+        for (const auto& include : entry.includes) {
+            _includedBy[include].erase(name);
+        }
+        entry.source = std::move(source);
+        entry.hash = hash;
+        entry.includes = scanIncludes(entry.source);
+        for (const auto& include : entry.includes) {
+            _includedBy[include].insert(name);
+        }
+        invalidate(name);
+        prune();
+        return true;
+    }
+
+    bool contains(const String& name) const {
+        return _entries.count(name);
+    }
+
+    // Obtain template with all partials expanded, throws std::out_of_range for unknown names
+    Ptr get(const String& name) {
+        std::vector<String> stack;
+        return compile(name, stack);
+    }
+
+    // Number of parses done so far (cache misses)
+    size_t parseCount() const {
+        return _parseCount;
+    }
+
+    // Number of cached parse results, including those not released yet
+    size_t cacheSize() const {
+        return _cache.size();
+    }
+
+    // FNV-1a hash of content
+    static constexpr uint64_t contentHash(StringView str, uint64_t hash = 14695981039346656037ull) {
+        for (const auto c : str) {
+            hash = (hash ^ static_cast<uint8_t>(c)) * 1099511628211ull;
+        }
+        return hash;
+    }
+
+private:
+    struct Entry {
+        String source;
+        uint64_t hash = 0;
+        std::vector<String> includes;
+        // Hash of content including all partials, valid while compiled is set
+        uint64_t key = 0;
+        Ptr compiled;
+    };
+
+    static std::vector<String> scanIncludes(StringView source) {
+        std::vector<String> includes;
+        for (auto pos = source.find("{{>"); pos != StringView::npos; pos = source.find("{{>", pos)) {
+            const auto end = source.find("}}", pos + 3);
+            if (end == StringView::npos) {
+                break;
+            }
+            includes.emplace_back(source.substr(pos + 3, end - pos - 3));
+            pos = end + 2;
+        }
+        return includes;
+    }
+
+    // Drop compiled template of name and of all templates including it
+    void invalidate(const String& name) {
+        std::unordered_set<String> visited;
+        std::vector<String> pending { name };
+        while (!pending.empty()) {
+            const auto current = std::move(pending.back());
+            pending.pop_back();
+            if (!visited.insert(current).second) {
+                continue;
+            }
+            if (const auto entry = _entries.find(current); entry != _entries.end()) {
+                entry->second.compiled.reset();
+            }
+            if (const auto includers = _includedBy.find(current); includers != _includedBy.end()) {
+                pending.insert(pending.end(), includers->second.begin(), includers->second.end());
+            }
+        }
+    }
+
+    // Parse result of a source with its expanded partials. Partials are held, so their identity
+    // stands for their content while the result is alive.
+    struct Cached {
+        std::weak_ptr<const Template> compiled;
+        String source;
+        std::vector<Ptr> partials;
+    };
+
+    // Drop cached results no longer used, which may release the partials of others
+    void prune() {
+        for (bool isPruned = true; isPruned;) {
+            isPruned = false;
+            for (auto it = _cache.begin(); it != _cache.end();) {
+                if (it->second.compiled.expired()) {
+                    it = _cache.erase(it);
+                    isPruned = true;
+                } else {
+                    ++it;
+                }
+            }
+        }
+    }
+
+    static uint64_t combine(uint64_t hash, uint64_t value) {
+        for (size_t i = 0; i < sizeof(value); ++i) {
+            hash = (hash ^ ((value >> (i * 8)) & 0xff)) * 1099511628211ull;
+        }
+        return hash;
+    }
+
+    Ptr compile(const String& name, std::vector<String>& stack) {
+        auto& entry = _entries.at(name);
+        if (entry.compiled) {
+            return entry.compiled;
+        }
+        if (std::find(stack.begin(), stack.end(), name) != stack.end()) {
+            throw std::runtime_error("tinja::TemplateRegistry: recursive include of " + name);
+        }
+        stack.push_back(name);
+
+        // Compile partials first, the cache key covers their content as well
+        std::unordered_map<String, Ptr> partials;
+        std::vector<Ptr> included;
+        auto key = entry.hash;
+        for (const auto& include : entry.includes) {
+            if (_entries.count(include)) {
+                auto partial = compile(include, stack);
+                partials[include] = partial;
+                included.push_back(std::move(partial));
+                key = combine(key, _entries.at(include).key);
+            }
+        }
+        stack.pop_back();
+
+        // Hashes may collide, results are only reused for the same source and partials
+        Ptr compiled;
+        const auto [first, last] = _cache.equal_range(key);
+        for (auto it = first; it != last && !compiled; ++it) {
+            if (it->second.source == entry.source && it->second.partials == included) {
+                compiled = it->second.compiled.lock();
+            }
+        }
+        if (!compiled) {
+            auto templ = std::make_shared<Template>();
+            templ->parse(entry.source, [&](StringView include) -> const Template* {
+                const auto it = partials.find(String(include));
+                return it == partials.end() ? nullptr : it->second.get();
+            });
+            ++_parseCount;
+            compiled = std::move(templ);
+            _cache.emplace(key, Cached { compiled, entry.source, std::move(included) });
+        }
+        entry.key = key;
+        entry.compiled = compiled;
+        return compiled;
+    }
+
+    std::unordered_map<String, Entry> _entries;
+    std::unordered_map<String, std::unordered_set<String>> _includedBy;
+    std::unordered_multimap<uint64_t, Cached> _cache;
+    size_t _parseCount = 0;
+};
+
+} // namespace tinja
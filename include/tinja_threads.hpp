@@ -0,0 +1,244 @@
+#pragma once
+
+#include "tinja.hpp"
+
+#include <atomic>
+#include <condition_variable>
+#include <exception>
+#include <memory>
+#include <mutex>
+#include <thread>
+
+namespace tinja {
+
+// Worker threads for parallel rendering of large arrays. Arrays are split into chunks of at least
+// minChunkSize elements, rendered by the workers and the calling thread, and emitted in order.
+class ThreadPool {
+public:
+    explicit ThreadPool(size_t workerCount = std::max(1u, std::thread::hardware_concurrency()) - 1, size_t minChunkSize = 1024) :
+        _minChunkSize(std::max<size_t>(1, minChunkSize)) {
+        for (size_t i = 0; i < workerCount; ++i) {
+            _workers.emplace_back([this] { work(); });
+        }
+    }
+
+    ~ThreadPool() {
+        {
+            std::lock_guard<std::mutex> lock(_mutex);
+            _isStopped = true;
+        }
+        _wake.notify_all();
+        for (auto& worker : _workers) {
+            worker.join();
+        }
+    }
+
+    ThreadPool(const ThreadPool&) = delete;
+    ThreadPool& operator=(const ThreadPool&) = delete;
+
+    size_t workerCount() const {
+        return _workers.size();
+    }
+
+    size_t minChunkSize() const {
+        return _minChunkSize;
+    }
+
+    // Obtain number of chunks to split an array of size into, 1 if not worth splitting
+    size_t chunkCount(size_t size) const {
+        if (_workers.empty() || running() == this) {
+            return 1;
+        }
+        // A few chunks per thread balance uneven elements
+        return std::max<size_t>(1, std::min(size / _minChunkSize, (_workers.size() + 1) * 4));
+    }
+
+    // Call task(i) for each i in [0, count) on workers and the calling thread, returns when all are
+    // done. Rethrows the first exception thrown by a task. Nested calls from a task of this pool run
+    // inline on the calling thread, since the workers are busy with the outer call.
+    template<class Task>
+    void run(size_t count, Task&& task) {
+        if (running() == this) {
+            for (size_t i = 0; i < count; ++i) {
+                task(i);
+            }
+            return;
+        }
+        std::lock_guard<std::mutex> runLock(_runMutex);
+        {
+            std::lock_guard<std::mutex> lock(_mutex);
+            _context = &task;
+            _invoke = [](void* context, size_t i) { (*static_cast<std::decay_t<Task>*>(context))(i); };
+            _count = count;
+            _next = 0;
+            _busyCount = _workers.size();
+            _error = nullptr;
+            ++_generation;
+        }
+        _wake.notify_all();
+        const auto outer = std::exchange(running(), this);
+        runTasks();
+        running() = outer;
+        std::unique_lock<std::mutex> lock(_mutex);
+        _done.wait(lock, [&] { return _busyCount == 0; });
+        if (_error) {
+            std::rethrow_exception(_error);
+        }
+    }
+
+private:
+    // Pool whose tasks the current thread runs, if any
+    static const ThreadPool*& running() {
+        thread_local const ThreadPool* pool = nullptr;
+        return pool;
+    }
+
+    void work() {
+        running() = this;
+        size_t generation = 0;
+        std::unique_lock<std::mutex> lock(_mutex);
+        while (true) {
+            _wake.wait(lock, [&] { return _isStopped || _generation != generation; });
+            if (_isStopped) {
+                return;
+            }
+            generation = _generation;
+            lock.unlock();
+            runTasks();
+            lock.lock();
+            if (--_busyCount == 0) {
+                _done.notify_one();
+            }
+        }
+    }
+
+    void runTasks() {
+        for (auto i = _next++; i < _count; i = _next++) {
+            try {
+                _invoke(_context, i);
+            } catch (...) {
+                std::lock_guard<std::mutex> lock(_mutex);
+                if (!_error) {
+                    _error = std::current_exception();
+                }
+            }
+        }
+    }
+
+    const size_t _minChunkSize;
+    std::vector<std::thread> _workers;
+    // Serializes concurrent calls of run()
+    std::mutex _runMutex;
+    std::mutex _mutex;
+    std::condition_variable _wake;
+    std::condition_variable _done;
+    bool _isStopped = false;
+    size_t _generation = 0;
+    size_t _busyCount = 0;
+    void* _context = nullptr;
+    void (*_invoke)(void*, size_t) = nullptr;
+    size_t _count = 0;
+    std::atomic<size_t> _next = 0;
+    std::exception_ptr _error;
+};
+
+// Shared handle to an immutable template (Template, TemplateView, Program), which any number of
+// threads can render concurrently. Reloads swap in a new template atomically (RCU-style) and
+// in-flight renders keep their snapshot alive. Each thread caches a weak reference to the snapshot
+// of each SharedTemplate, so a render only pins it with a reference count. The shared pointer is
+// loaded after a reload or on the first render of a thread, which takes a lock where
+// std::shared_ptr atomics are not lock-free (e.g. libstdc++), as does store().
+template<class T>
+class SharedTemplate {
+public:
+    using Ptr = std::shared_ptr<const T>;
+
+    SharedTemplate() :
+        SharedTemplate(T {}) {
+    }
+
+    explicit SharedTemplate(T templ) :
+        _templ(makePtr(std::move(templ))),
+        _version(nextVersion()) {
+    }
+
+    SharedTemplate(const SharedTemplate&) = delete;
+    SharedTemplate& operator=(const SharedTemplate&) = delete;
+
+    // Obtain current snapshot, which stays valid while held
+    Ptr get() const {
+        return std::atomic_load_explicit(&_templ, std::memory_order_acquire);
+    }
+
+    // Replace template, e.g. on hot reload. The previous template is freed by the last render
+    // holding it.
+    void store(T templ) {
+        std::atomic_store_explicit(&_templ, makePtr(std::move(templ)), std::memory_order_release);
+        _version.store(nextVersion(), std::memory_order_release);
+    }
+
+    template<class Source, class Sink>
+    void renderTo(const Source& source, Sink&& sink) const {
+        const auto snapshot = pin();
+        snapshot->renderTo(source, std::forward<Sink>(sink));
+    }
+
+    // Render into a reusable per-thread buffer, the view is valid until the next render on this thread
+    template<class Source>
+    StringView render(const Source& source) const {
+        thread_local String buffer;
+        buffer.clear();
+        const auto snapshot = pin();
+        snapshot->renderTo(source, StringSink { buffer });
+        return buffer;
+    }
+
+private:
+    // Templates are allocated apart from their reference counts, so the weak references of caches
+    // only keep the counts of released templates
+    static Ptr makePtr(T templ) {
+        return Ptr(new const T(std::move(templ)));
+    }
+
+    static uint64_t nextVersion() {
+        static std::atomic<uint64_t> version { 0 };
+        return ++version;
+    }
+
+    struct Entry {
+        uint64_t version = 0;
+        std::weak_ptr<const T> templ;
+    };
+
+    // Snapshots cached by this thread, by template (versions are unique, so entries of destroyed
+    // templates never match a new one)
+    using Cache = std::unordered_map<const SharedTemplate*, Entry>;
+
+    static Cache& cache() {
+        thread_local Cache cache;
+        return cache;
+    }
+
+    // Obtain snapshot for one render, from the cache of this thread unless reloaded since
+    Ptr pin() const {
+        const auto version = _version.load(std::memory_order_acquire);
+        auto& entries = cache();
+        if (const auto it = entries.find(this); it != entries.end() && it->second.version == version) {
+            if (auto templ = it->second.templ.lock()) {
+                return templ;
+            }
+        }
+        // Drop entries of released snapshots (of reloaded or destroyed templates)
+        for (auto it = entries.begin(); it != entries.end();) {
+            it = it->second.templ.expired() ? entries.erase(it) : std::next(it);
+        }
+        auto templ = get();
+        entries[this] = { version, templ };
+        return templ;
+    }
+
+    Ptr _templ;
+    std::atomic<uint64_t> _version;
+};
+
+} // namespace tinja
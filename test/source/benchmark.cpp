@@ -2,6 +2,8 @@
 #include <catch2/benchmark/catch_benchmark.hpp>
 
 #include <tinja.hpp>
+#include <tinja_gzip.hpp>
+#include <tinja_threads.hpp>
 
 #include <bustache/format.hpp>
 #include <bustache/render/string.hpp>
@@ -13,6 +15,15 @@
 #include "micro_mustache.hpp"
 #include "kainjow_mustache.hpp"
 #include "util.hpp"
+#include "circuco_basic.hpp"
+#include "circuco_basic_image.hpp"
+
+#include <chrono>
+#include <memory_resource>
+#include <thread>
+
+#include <fcntl.h>
+#include <unistd.h>
 
 constexpr size_t loopSize = 60;
 
@@ -29,6 +40,17 @@ std::string concat(const tinja::Template::Tokens& tinjaTokens) {
     return str;
 }
 
+tinja::DataSlots toSlots(const tinja::DataMap& dataMap, tinja::Schema& schema) {
+    for (const auto& kv : dataMap) {
+        schema.slot(kv.first);
+    }
+    tinja::DataSlots slots(schema);
+    for (const auto& [key, value] : dataMap) {
+        slots[key] = value;
+    }
+    return slots;
+}
+
 TEST_CASE("Performance comparison", "[benchmark]") {
     const auto basicString = readHtmlFile("circuco_basic.html");
     const auto injaString = readHtmlFile("circuco_inja.html");
@@ -176,6 +198,10 @@ TEST_CASE("Performance comparison", "[benchmark]") {
             tinjaTempl.renderTo(tinjaData, tinjaTokens);
             const auto tinjaDoc = concat(tinjaTokens);
             REQUIRE(tinjaDoc == bustacheDoc);
+
+            std::string staticDoc;
+            tinja::StaticTemplate<circucoBasic>().renderTo(tinjaData, tinja::StringSink { staticDoc });
+            REQUIRE(staticDoc == tinja::Template(circucoBasic).render(tinjaData));
         }
 
         BENCHMARK_ADVANCED("micro_mustache")(Catch::Benchmark::Chronometer meter) {
@@ -216,6 +242,14 @@ TEST_CASE("Performance comparison", "[benchmark]") {
             });
         };
 
+        BENCHMARK_ADVANCED("tinja --view")(Catch::Benchmark::Chronometer meter) {
+            meter.measure([&] {
+                tinja::TemplateView templ(basicString);
+                tinja::TemplateView::Tokens tokens;
+                return templ.renderTo(tinjaData, tokens);
+            });
+        };
+
         BENCHMARK_ADVANCED("tinja --concat")(Catch::Benchmark::Chronometer meter) {
             meter.measure([&] {
                 tinja::Template templ(basicString);
@@ -233,6 +267,177 @@ TEST_CASE("Performance comparison", "[benchmark]") {
                 return concat(tokens);
             });
         };
+
+        BENCHMARK_ADVANCED("tinja --sink")(Catch::Benchmark::Chronometer meter) {
+            meter.measure([&] {
+                tinja::Template templ(basicString);
+                std::string str;
+                templ.renderTo(tinjaData, tinja::StringSink { str });
+                return str;
+            });
+        };
+
+        // Parse and render out of one monotonic arena per request
+        BENCHMARK_ADVANCED("tinja --arena")(Catch::Benchmark::Chronometer meter) {
+            std::vector<std::byte> buffer(64 * 1024);
+            meter.measure([&] {
+                std::pmr::monotonic_buffer_resource arena(buffer.data(), buffer.size());
+                tinja::PmrTemplate templ(basicString, 0, &arena);
+                tinja::PmrTemplate::Tokens tokens(&arena);
+                templ.renderTo(tinjaData, tokens);
+                return tokens.size();
+            });
+        };
+
+        BENCHMARK_ADVANCED("tinja --view --arena")(Catch::Benchmark::Chronometer meter) {
+            std::vector<std::byte> buffer(64 * 1024);
+            meter.measure([&] {
+                std::pmr::monotonic_buffer_resource arena(buffer.data(), buffer.size());
+                tinja::TemplateView templ(basicString, 0, &arena);
+                tinja::TemplateView::Tokens tokens;
+                templ.renderTo(tinjaData, tokens);
+                return tokens.size();
+            });
+        };
+
+        BENCHMARK_ADVANCED("tinja --view --arena --sink")(Catch::Benchmark::Chronometer meter) {
+            std::vector<std::byte> buffer(64 * 1024);
+            meter.measure([&] {
+                std::pmr::monotonic_buffer_resource arena(buffer.data(), buffer.size());
+                tinja::TemplateView templ(basicString, 0, &arena);
+                std::pmr::string str(&arena);
+                templ.renderTo(tinjaData, [&](std::string_view token) { str.append(token); });
+                return str.size();
+            });
+        };
+
+        BENCHMARK_ADVANCED("tinja --static --sink")(Catch::Benchmark::Chronometer meter) {
+            meter.measure([&] {
+                tinja::StaticTemplate<circucoBasic> templ;
+                std::string str;
+                templ.renderTo(tinjaData, tinja::StringSink { str });
+                return str;
+            });
+        };
+    }
+
+    SECTION("parse") {
+        // Template with inline CSS, full of single braces
+        std::string cssString = basicString;
+        std::string style = "<style>";
+        for (int i = 0; i < 200; ++i) {
+            style += ".c" + std::to_string(i) + "{color:#" + std::to_string(100 + i) + ";margin:0 auto}";
+        }
+        style += "</style>";
+        cssString.insert(cssString.find("</head>"), style);
+
+        BENCHMARK_ADVANCED("tinja")(Catch::Benchmark::Chronometer meter) {
+            tinja::Template templ;
+            meter.measure([&] { return templ.parse(basicString); });
+        };
+
+        BENCHMARK_ADVANCED("tinja --view")(Catch::Benchmark::Chronometer meter) {
+            tinja::TemplateView templ;
+            meter.measure([&] { return templ.parse(basicString); });
+        };
+
+        BENCHMARK_ADVANCED("tinja --css")(Catch::Benchmark::Chronometer meter) {
+            tinja::Template templ;
+            meter.measure([&] { return templ.parse(cssString); });
+        };
+
+        BENCHMARK_ADVANCED("tinja --view --css")(Catch::Benchmark::Chronometer meter) {
+            tinja::TemplateView templ;
+            meter.measure([&] { return templ.parse(cssString); });
+        };
+
+        // Minification of the unminified page by regex passes vs. while parsing
+        std::string regexDoc, minifiedDoc;
+        tinja::Template(basicString).renderTo(tinjaData, tinja::StringSink { regexDoc });
+        tinja::Template minified;
+        minified.parse(circucoBasic, { true });
+        minified.renderTo(tinjaData, tinja::StringSink { minifiedDoc });
+        REQUIRE(minifiedDoc == regexDoc);
+
+        BENCHMARK_ADVANCED("tinja --regex")(Catch::Benchmark::Chronometer meter) {
+            tinja::Template templ;
+            meter.measure([&] {
+                std::string str = circucoBasic;
+                minifyHtml(str);
+                return templ.parse(str);
+            });
+        };
+
+        BENCHMARK_ADVANCED("tinja --minify")(Catch::Benchmark::Chronometer meter) {
+            tinja::Template templ;
+            meter.measure([&] { return templ.parse(circucoBasic, { true }); });
+        };
+
+        BENCHMARK_ADVANCED("tinja --view --minify")(Catch::Benchmark::Chronometer meter) {
+            tinja::TemplateView templ;
+            meter.measure([&] { return templ.parse(circucoBasic, { true }); });
+        };
+    }
+
+    SECTION("startup") {
+        // Parsing at boot vs. viewing an image compiled at build time (see tools/tinjac.cpp), both
+        // from the unminified page
+        std::string parsedDoc, viewedDoc;
+        tinja::Template(circucoBasic).renderTo(tinjaData, tinja::StringSink { parsedDoc });
+        tinja::Program::view(circucoBasicImage, sizeof(circucoBasicImage)).renderTo(tinjaData, tinja::StringSink { viewedDoc });
+        REQUIRE(viewedDoc == parsedDoc);
+
+        BENCHMARK_ADVANCED("tinja --parse")(Catch::Benchmark::Chronometer meter) {
+            meter.measure([&] { return tinja::Template(circucoBasic); });
+        };
+
+        BENCHMARK_ADVANCED("tinja --program --parse")(Catch::Benchmark::Chronometer meter) {
+            meter.measure([&] { return tinja::Program(tinja::TemplateView(circucoBasic)); });
+        };
+
+        BENCHMARK_ADVANCED("tinja --program --image")(Catch::Benchmark::Chronometer meter) {
+            meter.measure([&] { return tinja::Program::view(circucoBasicImage, sizeof(circucoBasicImage)); });
+        };
+    }
+
+    SECTION("gzip") {
+        // Compressing the whole render vs. stitching pre-compressed text with dynamic bytes
+        const tinja::Program program { tinja::Template(basicString) };
+        const tinja::GzipProgram gzip { program };
+        z_stream stream {};
+        deflateInit2(&stream, Z_DEFAULT_COMPRESSION, Z_DEFLATED, 16 + MAX_WBITS, 8, Z_DEFAULT_STRATEGY);
+        std::string doc, compressed;
+        const auto compress = [&] {
+            doc.clear();
+            program.renderTo(tinjaData, tinja::StringSink { doc });
+            deflateReset(&stream);
+            compressed.resize(deflateBound(&stream, doc.size()));
+            stream.next_in = reinterpret_cast<Bytef*>(doc.data());
+            stream.avail_in = static_cast<uInt>(doc.size());
+            stream.next_out = reinterpret_cast<Bytef*>(compressed.data());
+            stream.avail_out = static_cast<uInt>(compressed.size());
+            deflate(&stream, Z_FINISH);
+            compressed.resize(stream.total_out);
+            return compressed.size();
+        };
+        std::string stitched;
+        gzip.renderTo(tinjaData, stitched);
+        compress();
+        std::cout << "tinja> " << doc.size() << " bytes compress to " << compressed.size() << " bytes, stitched to "
+                  << stitched.size() << " bytes" << std::endl;
+
+        BENCHMARK_ADVANCED("tinja --program --deflate")(Catch::Benchmark::Chronometer meter) {
+            meter.measure(compress);
+        };
+
+        BENCHMARK_ADVANCED("tinja --program --gzip")(Catch::Benchmark::Chronometer meter) {
+            meter.measure([&] {
+                stitched.clear();
+                gzip.renderTo(tinjaData, stitched);
+                return stitched.size();
+            });
+        };
+        deflateEnd(&stream);
     }
 
     SECTION("preparsed") {
@@ -270,6 +475,116 @@ TEST_CASE("Performance comparison", "[benchmark]") {
                 return concat(tinjaTokens);
             });
         };
+
+        BENCHMARK_ADVANCED("tinja --sink")(Catch::Benchmark::Chronometer meter) {
+            tinja::Template templ(basicString);
+            meter.measure([&] {
+                std::string str;
+                templ.renderTo(tinjaData, tinja::StringSink { str });
+                return str;
+            });
+        };
+
+        BENCHMARK_ADVANCED("tinja --render")(Catch::Benchmark::Chronometer meter) {
+            tinja::Template templ(basicString);
+            meter.measure([&] { return templ.render(tinjaData); });
+        };
+
+        BENCHMARK_ADVANCED("tinja --bound")(Catch::Benchmark::Chronometer meter) {
+            tinja::Template templ(basicString);
+            tinja::Schema schema;
+            templ.bind(schema);
+            const auto slots = toSlots(tinjaData, schema);
+            meter.measure([&] { return templ.renderTo(slots, tinjaTokens); });
+        };
+
+        BENCHMARK_ADVANCED("tinja --bound --sink")(Catch::Benchmark::Chronometer meter) {
+            tinja::Template templ(basicString);
+            tinja::Schema schema;
+            templ.bind(schema);
+            const auto slots = toSlots(tinjaData, schema);
+            std::string str;
+            meter.measure([&] {
+                str.clear();
+                templ.renderTo(slots, tinja::StringSink { str });
+                return str.size();
+            });
+        };
+
+        BENCHMARK_ADVANCED("tinja --program --bound --sink")(Catch::Benchmark::Chronometer meter) {
+            tinja::Program program(tinja::Template { basicString });
+            tinja::Schema schema;
+            program.bind(schema);
+            const auto slots = toSlots(tinjaData, schema);
+            std::string str;
+            meter.measure([&] {
+                str.clear();
+                program.renderTo(slots, tinja::StringSink { str });
+                return str.size();
+            });
+        };
+
+        BENCHMARK_ADVANCED("tinja --bound --render")(Catch::Benchmark::Chronometer meter) {
+            tinja::Template templ(basicString);
+            tinja::Schema schema;
+            templ.bind(schema);
+            const auto slots = toSlots(tinjaData, schema);
+            meter.measure([&] { return templ.render(slots); });
+        };
+
+        // Per tick only v, p and dv change
+        BENCHMARK_ADVANCED("tinja --bound --incremental")(Catch::Benchmark::Chronometer meter) {
+            tinja::Template templ(basicString);
+            tinja::Schema schema;
+            templ.bind(schema);
+            for (const auto& kv : tinjaData) {
+                schema.slot(kv.first);
+            }
+            tinja::TrackedSlots slots(schema);
+            for (const auto& [key, value] : tinjaData) {
+                slots.set(key, value);
+            }
+            tinja::IncrementalRenderer<tinja::Template> renderer(templ);
+            renderer.update(slots);
+            const std::string values[] = { "52.3 °C", "52.4 °C" };
+            size_t tick = 0;
+            meter.measure([&] {
+                ++tick;
+                slots.set("v", values[tick % 2]);
+                slots.set("p", values[(tick + 1) % 2]);
+                slots.set("dv", values[(tick + 1) % 2]);
+                return renderer.update(slots).size();
+            });
+        };
+
+        BENCHMARK_ADVANCED("tinja --bound --incremental --delta")(Catch::Benchmark::Chronometer meter) {
+            tinja::Template templ(basicString);
+            tinja::Schema schema;
+            templ.bind(schema);
+            for (const auto& kv : tinjaData) {
+                schema.slot(kv.first);
+            }
+            tinja::TrackedSlots slots(schema);
+            for (const auto& [key, value] : tinjaData) {
+                slots.set(key, value);
+            }
+            tinja::IncrementalRenderer<tinja::Template> renderer(templ);
+            renderer.update(slots);
+            std::string records;
+            const std::string values[] = { "52.3 °C", "52.4 °C" };
+            size_t tick = 0;
+            meter.measure([&] {
+                ++tick;
+                slots.set("v", values[tick % 2]);
+                slots.set("p", values[(tick + 1) % 2]);
+                slots.set("dv", values[(tick + 1) % 2]);
+                records.clear();
+                renderer.update(slots, [&](size_t node, std::string_view value) {
+                    tinja::appendDelta(records, node, value);
+                });
+                return records.size();
+            });
+        };
     }
 
     SECTION("arrays") {
@@ -332,6 +647,11 @@ TEST_CASE("Performance comparison", "[benchmark]") {
             REQUIRE(injaDoc == bustacheDocJson);
             //REQUIRE(bustacheDocJson == bustacheDocNative);
             REQUIRE(bustacheDocJson == concat(tinjaTokens));
+            REQUIRE(tinjaTempl.render(tinjaData) == concat(tinjaTokens));
+            std::string programDoc;
+            tinja::Program(tinjaTempl).renderTo(tinjaData, tinja::StringSink { programDoc });
+            REQUIRE(programDoc == concat(tinjaTokens));
+            REQUIRE(tinjaTempl.renderedSize(tinjaData) == concat(tinjaTokens).size());
         }
 
         BENCHMARK_ADVANCED("kainjow_mustache")(Catch::Benchmark::Chronometer meter) {
@@ -360,5 +680,294 @@ TEST_CASE("Performance comparison", "[benchmark]") {
                 return concat(tinjaTokens);
             });
         };
+
+        BENCHMARK_ADVANCED("tinja --sink")(Catch::Benchmark::Chronometer meter) {
+            meter.measure([&] {
+                std::string str;
+                tinjaTempl.renderTo(tinjaData, tinja::StringSink { str });
+                return str;
+            });
+        };
+
+        BENCHMARK_ADVANCED("tinja --render")(Catch::Benchmark::Chronometer meter) {
+            meter.measure([&] { return tinjaTempl.render(tinjaData); });
+        };
+
+        BENCHMARK_ADVANCED("tinja --concat --write")(Catch::Benchmark::Chronometer meter) {
+            const auto fd = open("/dev/null", O_WRONLY);
+            meter.measure([&] {
+                tinjaTempl.renderTo(tinjaData, tinjaTokens);
+                const auto str = concat(tinjaTokens);
+                return write(fd, str.data(), str.size());
+            });
+            close(fd);
+        };
+
+        BENCHMARK_ADVANCED("tinja --writev")(Catch::Benchmark::Chronometer meter) {
+            const auto fd = open("/dev/null", O_WRONLY);
+            auto flush = [&](const iovec* iovs, int count) { writev(fd, iovs, count); };
+            tinja::IovecSink<decltype(flush)> sink(flush);
+            meter.measure([&] {
+                tinjaTempl.renderTo(tinjaData, sink);
+                sink.flush();
+            });
+            close(fd);
+        };
+
+        BENCHMARK_ADVANCED("tinja --bound")(Catch::Benchmark::Chronometer meter) {
+            tinja::Schema schema;
+            tinjaTempl.bind(schema);
+            const auto slots = toSlots(tinjaData, schema);
+            meter.measure([&] { return tinjaTempl.renderTo(slots, tinjaTokens); });
+        };
+
+        BENCHMARK_ADVANCED("tinja --bound --sink")(Catch::Benchmark::Chronometer meter) {
+            tinja::Schema schema;
+            tinjaTempl.bind(schema);
+            const auto slots = toSlots(tinjaData, schema);
+            std::string str;
+            meter.measure([&] {
+                str.clear();
+                tinjaTempl.renderTo(slots, tinja::StringSink { str });
+                return str.size();
+            });
+        };
+
+        BENCHMARK_ADVANCED("tinja --program --bound --sink")(Catch::Benchmark::Chronometer meter) {
+            tinja::Program program(tinjaTempl);
+            tinja::Schema schema;
+            program.bind(schema);
+            const auto slots = toSlots(tinjaData, schema);
+            std::string str;
+            meter.measure([&] {
+                str.clear();
+                program.renderTo(slots, tinja::StringSink { str });
+                return str.size();
+            });
+        };
+
+        // Numeric samples, stringified per render vs. formatted from typed columns
+        std::vector<int> ahValues, shValues;
+        for (int i = 0; i < loopSize; ++i) {
+            ahValues.push_back(i+2);
+            shValues.push_back(i+1);
+        }
+
+        BENCHMARK_ADVANCED("tinja --to_string --bound --sink")(Catch::Benchmark::Chronometer meter) {
+            tinja::Schema schema;
+            tinjaTempl.bind(schema);
+            auto slots = toSlots(tinjaData, schema);
+            std::string str;
+            meter.measure([&] {
+                tinja::Strings ahStrings, shStrings;
+                for (size_t i = 0; i < loopSize; ++i) {
+                    ahStrings.push_back(std::to_string(ahValues[i]));
+                    shStrings.push_back(std::to_string(shValues[i]));
+                }
+                slots["ah"] = std::move(ahStrings);
+                slots["sh"] = std::move(shStrings);
+                str.clear();
+                tinjaTempl.renderTo(slots, tinja::StringSink { str });
+                return str.size();
+            });
+        };
+
+        BENCHMARK_ADVANCED("tinja --columns --bound --sink")(Catch::Benchmark::Chronometer meter) {
+            tinja::Schema schema;
+            tinjaTempl.bind(schema);
+            auto slots = toSlots(tinjaData, schema);
+            slots["ah"] = tinja::Column(ahValues);
+            slots["sh"] = tinja::Column(shValues);
+            std::string str;
+            tinjaTempl.renderTo(slots, tinja::StringSink { str });
+            REQUIRE(str == tinjaTempl.render(tinjaData));
+            meter.measure([&] {
+                str.clear();
+                tinjaTempl.renderTo(slots, tinja::StringSink { str });
+                return str.size();
+            });
+        };
+        BENCHMARK_ADVANCED("tinja --refs --bound --sink")(Catch::Benchmark::Chronometer meter) {
+            tinja::Schema schema;
+            tinjaTempl.bind(schema);
+            auto slots = toSlots(tinjaData, schema);
+            std::string str;
+            meter.measure([&] {
+                slots["ah"] = tinja::StringRefs(ah.begin(), ah.end());
+                slots["sh"] = tinja::StringRefs(sh.begin(), sh.end());
+                str.clear();
+                tinjaTempl.renderTo(slots, tinja::StringSink { str });
+                return str.size();
+            });
+        };
+
+        BENCHMARK_ADVANCED("tinja --spans --bound --sink")(Catch::Benchmark::Chronometer meter) {
+            tinja::Schema schema;
+            tinjaTempl.bind(schema);
+            auto slots = toSlots(tinjaData, schema);
+            std::string str;
+            meter.measure([&] {
+                slots["ah"] = tinja::Column(ah);
+                slots["sh"] = tinja::Column(sh);
+                str.clear();
+                tinjaTempl.renderTo(slots, tinja::StringSink { str });
+                return str.size();
+            });
+        };
+    }
+
+    SECTION("rows") {
+        // Tables with many rows, serial vs. chunks rendered in parallel
+        tinja::Template templ(tinjaString);
+        tinja::ThreadPool pool;
+        for (const size_t rowCount : { size_t(60), size_t(1000), size_t(10000), size_t(100000) }) {
+            std::vector<int> ahValues(rowCount), shValues(rowCount);
+            for (size_t i = 0; i < rowCount; ++i) {
+                ahValues[i] = static_cast<int>(i+2);
+                shValues[i] = static_cast<int>(i+1);
+            }
+            tinjaData["ah"] = tinja::Column(ahValues);
+            tinjaData["sh"] = tinja::Column(shValues);
+            std::string str;
+            REQUIRE(templ.render(tinjaData, pool) == templ.render(tinjaData));
+
+            BENCHMARK_ADVANCED("tinja --sink --rows " + std::to_string(rowCount))(Catch::Benchmark::Chronometer meter) {
+                meter.measure([&] {
+                    str.clear();
+                    templ.renderTo(tinjaData, tinja::StringSink { str });
+                    return str.size();
+                });
+            };
+
+            BENCHMARK_ADVANCED("tinja --sink --parallel --rows " + std::to_string(rowCount))(Catch::Benchmark::Chronometer meter) {
+                meter.measure([&] {
+                    str.clear();
+                    templ.renderTo(tinjaData, tinja::StringSink { str }, pool);
+                    return str.size();
+                });
+            };
+        }
+    }
+
+    SECTION("escape") {
+        // Table of mostly clean user strings: escaping copies on each update vs. escaping while rendering
+        tinja::Strings names(1000);
+        for (size_t i = 0; i < names.size(); ++i) {
+            names[i] = "sensor " + std::to_string(i) + (i % 100 ? "" : " <fault>");
+        }
+        tinja::Template raw("<table>{[<tr><td>{{n}}</td></tr>]}</table>");
+        tinja::Template escaping;
+        escaping.parse("<table>{[<tr><td>{{n}}</td></tr>]}</table>", { false, true });
+        tinja::DataMap data;
+        data["n"] = tinja::Column(names);
+        const auto expected = escaping.render(data);
+        REQUIRE(expected.find("&lt;fault&gt;") != std::string::npos);
+        std::string str;
+
+        BENCHMARK_ADVANCED("tinja --copy")(Catch::Benchmark::Chronometer meter) {
+            meter.measure([&] {
+                tinja::Strings escaped(names.size());
+                for (size_t i = 0; i < names.size(); ++i) {
+                    tinja::appendEscapedHtml(escaped[i], names[i]);
+                }
+                data["n"] = std::move(escaped);
+                str.clear();
+                raw.renderTo(data, tinja::StringSink { str });
+                return str.size();
+            });
+        };
+
+        BENCHMARK_ADVANCED("tinja --escape")(Catch::Benchmark::Chronometer meter) {
+            meter.measure([&] {
+                data["n"] = tinja::Column(names);
+                str.clear();
+                escaping.renderTo(data, tinja::StringSink { str });
+                return str.size();
+            });
+        };
+    }
+
+    SECTION("batch") {
+        // One report per device, documents per second is the headline
+        constexpr size_t deviceCount = 1000;
+        tinja::Template templ(tinjaString);
+        std::vector<tinja::DataMap> devices(deviceCount, tinjaData);
+        for (size_t i = 0; i < deviceCount; ++i) {
+            devices[i]["v"] = std::to_string(i) + " °C";
+            devices[i]["sh"] = tinja::Strings(loopSize, std::to_string(i % 10));
+            devices[i]["ah"] = tinja::Strings(loopSize, std::to_string(i % 7));
+        }
+        tinja::Batch batch;
+        tinja::ThreadPool pool;
+
+        const auto docsPerSecond = [&](auto&& renderAll) {
+            const auto start = std::chrono::steady_clock::now();
+            renderAll();
+            const std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+            return static_cast<size_t>(deviceCount / elapsed.count());
+        };
+        std::cout << "tinja> single renders: " << docsPerSecond([&] {
+            for (const auto& device : devices) {
+                templ.render(device);
+            }
+        }) << " docs/s, batch: " << docsPerSecond([&] {
+            batch.clear();
+            templ.renderBatch(devices, batch);
+        }) << " docs/s, parallel batch: " << docsPerSecond([&] {
+            batch.clear();
+            templ.renderBatch(devices, batch, &pool);
+        }) << " docs/s" << std::endl;
+
+        BENCHMARK_ADVANCED("tinja --render --docs 1000")(Catch::Benchmark::Chronometer meter) {
+            meter.measure([&] {
+                size_t size = 0;
+                for (const auto& device : devices) {
+                    size += templ.render(device).size();
+                }
+                return size;
+            });
+        };
+
+        BENCHMARK_ADVANCED("tinja --batch --docs 1000")(Catch::Benchmark::Chronometer meter) {
+            meter.measure([&] {
+                batch.clear();
+                templ.renderBatch(devices, batch);
+                return batch.size();
+            });
+        };
+
+        BENCHMARK_ADVANCED("tinja --batch --parallel --docs 1000")(Catch::Benchmark::Chronometer meter) {
+            meter.measure([&] {
+                batch.clear();
+                templ.renderBatch(devices, batch, &pool);
+                return batch.size();
+            });
+        };
+    }
+
+    SECTION("threads") {
+        // Render throughput of one shared template across threads, should scale with cores
+        constexpr size_t docCount = 4096;
+        tinja::SharedTemplate<tinja::Template> shared(tinja::Template { tinjaString });
+        tinjaData["sh"] = tinja::Strings(loopSize, "1");
+        tinjaData["ah"] = tinja::Strings(loopSize, "2");
+
+        for (size_t threadCount = 1; threadCount <= std::max(1u, std::thread::hardware_concurrency()); threadCount *= 2) {
+            // Threads are started once, outside of the timed loop
+            tinja::ThreadPool pool(threadCount - 1);
+            BENCHMARK_ADVANCED("tinja --threads " + std::to_string(threadCount))(Catch::Benchmark::Chronometer meter) {
+                meter.measure([&] {
+                    std::atomic<size_t> bytes = 0;
+                    pool.run(threadCount, [&](size_t) {
+                        size_t size = 0;
+                        for (size_t i = 0; i < docCount / threadCount; ++i) {
+                            size += shared.render(tinjaData).size();
+                        }
+                        bytes += size;
+                    });
+                    return bytes.load();
+                });
+            };
+        }
     }
 }
@@ -0,0 +1,378 @@
+// Standalone benchmark suite with generated templates and data, counting heap allocations.
+//
+//   tinja_bench [--quick] [--filter <substring>] [--json <file>]
+//
+// Parameters: template size, variable density (variables per KB), number of distinct keys and array
+// length (1 to 1M). Parse throughput is reported in MB/s, render throughput in docs/s and GB/s.
+// --json writes all results as one JSON document, e.g. to compare releases.
+
+#include <tinja.hpp>
+
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <new>
+#include <sstream>
+#include <string>
+#include <vector>
+
+// ---- Allocation counting ----
+
+// Replaced operator new and delete are seen by GCC as malloc/free pairs
+#if defined(__GNUC__) && !defined(__clang__) && __GNUC__ >= 11
+#pragma GCC diagnostic ignored "-Wmismatched-new-delete"
+#endif
+
+namespace {
+
+std::atomic<size_t> allocationCount { 0 };
+std::atomic<size_t> allocationBytes { 0 };
+
+void* allocate(size_t size, size_t alignment = 0) {
+    allocationCount.fetch_add(1, std::memory_order_relaxed);
+    allocationBytes.fetch_add(size, std::memory_order_relaxed);
+    void* ptr = nullptr;
+    if (alignment > alignof(std::max_align_t)) {
+        if (posix_memalign(&ptr, alignment, size ? size : 1) != 0) {
+            ptr = nullptr;
+        }
+    } else {
+        ptr = std::malloc(size ? size : 1);
+    }
+    return ptr;
+}
+
+} // namespace
+
+void* operator new(size_t size) {
+    if (auto* ptr = allocate(size)) {
+        return ptr;
+    }
+    throw std::bad_alloc();
+}
+
+void* operator new[](size_t size) {
+    return operator new(size);
+}
+
+void* operator new(size_t size, std::align_val_t alignment) {
+    if (auto* ptr = allocate(size, static_cast<size_t>(alignment))) {
+        return ptr;
+    }
+    throw std::bad_alloc();
+}
+
+void* operator new[](size_t size, std::align_val_t alignment) {
+    return operator new(size, alignment);
+}
+
+void* operator new(size_t size, const std::nothrow_t&) noexcept {
+    return allocate(size);
+}
+
+void* operator new[](size_t size, const std::nothrow_t&) noexcept {
+    return allocate(size);
+}
+
+void operator delete(void* ptr) noexcept { std::free(ptr); }
+void operator delete[](void* ptr) noexcept { std::free(ptr); }
+void operator delete(void* ptr, size_t) noexcept { std::free(ptr); }
+void operator delete[](void* ptr, size_t) noexcept { std::free(ptr); }
+void operator delete(void* ptr, std::align_val_t) noexcept { std::free(ptr); }
+void operator delete[](void* ptr, std::align_val_t) noexcept { std::free(ptr); }
+void operator delete(void* ptr, size_t, std::align_val_t) noexcept { std::free(ptr); }
+void operator delete[](void* ptr, size_t, std::align_val_t) noexcept { std::free(ptr); }
+
+namespace {
+
+// ---- Generators ----
+
+// Template of about size bytes of markup, with density variables per KB cycling through keyCount keys
+std::string makeTemplate(size_t size, size_t density, size_t keyCount) {
+    static const std::string markup =
+        "<div class=\"row\"><span class=\"label\">Temperature</span><td class=\"value\">"
+        "</td></tr>\n<tr><td>Pressure sensor reading</td>"
+        "<p style=\"margin:0 auto\">Lorem ipsum dolor sit amet, consectetur adipiscing elit.</p>\n";
+    std::string str;
+    str.reserve(size + 64);
+    // Text between variables
+    const auto gap = density ? 1024 / density : size;
+    size_t pos = 0;
+    for (size_t key = 0; str.size() < size; ++key) {
+        for (auto text = std::min(gap, size - str.size()); text > 0;) {
+            const auto n = std::min(text, markup.size() - pos);
+            str.append(markup, pos, n);
+            pos = (pos + n) % markup.size();
+            text -= n;
+        }
+        if (density) {
+            str += "{{k" + std::to_string(key % keyCount) + "}}";
+        }
+    }
+    return str;
+}
+
+tinja::DataMap makeData(size_t keyCount) {
+    tinja::DataMap data;
+    for (size_t i = 0; i < keyCount; ++i) {
+        data["k" + std::to_string(i)] = "value " + std::to_string(i);
+    }
+    return data;
+}
+
+// ---- Measurement ----
+
+struct Result {
+    std::string name;
+    std::vector<std::pair<std::string, size_t>> params;
+    size_t iterations = 0;
+    double nsPerOp = 0;
+    double allocationsPerOp = 0;
+    double bytesPerOp = 0;
+    // Throughput, zero if not applicable
+    double mbPerSec = 0;
+    double docsPerSec = 0;
+    double gbPerSec = 0;
+};
+
+struct Options {
+    bool isQuick = false;
+    std::string filter;
+    std::string jsonPath;
+};
+
+class Suite {
+public:
+    explicit Suite(Options options) : _options(std::move(options)) {
+    }
+
+    // Run op until the minimum time elapsed. inBytes are parsed, outBytes rendered per op.
+    template<class Op>
+    void run(const std::string& name, std::vector<std::pair<std::string, size_t>> params,
+             size_t inBytes, size_t outBytes, Op&& op) {
+        if (name.find(_options.filter) == std::string::npos) {
+            return;
+        }
+        // Warm up (and size reused buffers)
+        op();
+
+        const auto minTime = std::chrono::duration<double>(_options.isQuick ? 0.005 : 0.25);
+        size_t iterations = 0;
+        const auto allocations = allocationCount.load();
+        const auto bytes = allocationBytes.load();
+        const auto start = std::chrono::steady_clock::now();
+        std::chrono::duration<double> elapsed {};
+        do {
+            op();
+            ++iterations;
+            elapsed = std::chrono::steady_clock::now() - start;
+        } while (elapsed < minTime);
+
+        Result result;
+        result.name = name;
+        result.params = std::move(params);
+        result.iterations = iterations;
+        const auto seconds = elapsed.count() / iterations;
+        result.nsPerOp = seconds * 1e9;
+        result.allocationsPerOp = double(allocationCount.load() - allocations) / iterations;
+        result.bytesPerOp = double(allocationBytes.load() - bytes) / iterations;
+        if (inBytes) {
+            result.mbPerSec = inBytes / seconds / 1e6;
+        }
+        if (outBytes) {
+            result.docsPerSec = 1 / seconds;
+            result.gbPerSec = outBytes / seconds / 1e9;
+        }
+        print(result);
+        _results.push_back(std::move(result));
+    }
+
+    bool writeJson() const {
+        if (_options.jsonPath.empty()) {
+            return true;
+        }
+        std::ostringstream out;
+        out << "{\n  \"library\": \"tinja\",\n  \"quick\": " << (_options.isQuick ? "true" : "false")
+            << ",\n  \"stats\": " << (TINJA_STATS ? "true" : "false")
+            << ",\n  \"results\": [";
+        for (size_t i = 0; i < _results.size(); ++i) {
+            const auto& r = _results[i];
+            out << (i ? "," : "") << "\n    { \"name\": \"" << r.name << "\", \"params\": {";
+            for (size_t p = 0; p < r.params.size(); ++p) {
+                out << (p ? ", " : " ") << "\"" << r.params[p].first << "\": " << r.params[p].second;
+            }
+            out << " }, \"iterations\": " << r.iterations
+                << ", \"nsPerOp\": " << r.nsPerOp
+                << ", \"allocationsPerOp\": " << r.allocationsPerOp
+                << ", \"bytesPerOp\": " << r.bytesPerOp;
+            if (r.mbPerSec) {
+                out << ", \"mbPerSec\": " << r.mbPerSec;
+            }
+            if (r.docsPerSec) {
+                out << ", \"docsPerSec\": " << r.docsPerSec << ", \"gbPerSec\": " << r.gbPerSec;
+            }
+            out << " }";
+        }
+        out << "\n  ]\n}\n";
+        std::ofstream file(_options.jsonPath);
+        file << out.str();
+        return static_cast<bool>(file);
+    }
+
+    size_t size() const {
+        return _results.size();
+    }
+
+private:
+    static void print(const Result& r) {
+        std::string params;
+        for (const auto& [key, value] : r.params) {
+            params += " " + key + "=" + std::to_string(value);
+        }
+        std::printf("%-16s%-44s %12.1f ns %9.1f allocs %11.0f B", r.name.c_str(), params.c_str(),
+                    r.nsPerOp, r.allocationsPerOp, r.bytesPerOp);
+        if (r.mbPerSec) {
+            std::printf(" %9.1f MB/s", r.mbPerSec);
+        }
+        if (r.docsPerSec) {
+            std::printf(" %11.0f docs/s %7.3f GB/s", r.docsPerSec, r.gbPerSec);
+        }
+        std::printf("\n");
+    }
+
+    Options _options;
+    std::vector<Result> _results;
+};
+
+// ---- Cases ----
+
+void benchmarkTemplates(Suite& suite, bool isQuick) {
+    const std::vector<size_t> sizes = isQuick ? std::vector<size_t> { 1024, 16384 } :
+                                                std::vector<size_t> { 1024, 16384, 262144, 4194304 };
+    for (const size_t size : sizes) {
+        for (const size_t density : { size_t(1), size_t(16), size_t(128) }) {
+            for (const size_t keyCount : { size_t(16), size_t(1024) }) {
+                const auto source = makeTemplate(size, density, keyCount);
+                const auto data = makeData(keyCount);
+                const std::vector<std::pair<std::string, size_t>> params {
+                    { "size", size }, { "density", density }, { "keys", keyCount } };
+
+                tinja::Template templ;
+                suite.run("parse", params, source.size(), 0, [&] { templ.parse(source); });
+                tinja::TemplateView view;
+                suite.run("parse/view", params, source.size(), 0, [&] { view.parse(source); });
+
+                const auto docSize = templ.renderedSize(data);
+                std::string doc;
+                suite.run("render", params, 0, docSize, [&] {
+                    doc.clear();
+                    templ.renderTo(data, tinja::StringSink { doc });
+                });
+
+                tinja::Schema schema;
+                for (const auto& kv : data) {
+                    schema.slot(kv.first);
+                }
+                templ.bind(schema);
+                tinja::DataSlots slots(schema);
+                for (const auto& [key, value] : data) {
+                    slots[key] = value;
+                }
+                suite.run("render/bound", params, 0, docSize, [&] {
+                    doc.clear();
+                    templ.renderTo(slots, tinja::StringSink { doc });
+                });
+
+                const tinja::Program program(templ);
+                suite.run("render/program", params, 0, docSize, [&] {
+                    doc.clear();
+                    program.renderTo(slots, tinja::StringSink { doc });
+                });
+            }
+        }
+    }
+}
+
+void benchmarkArrays(Suite& suite, bool isQuick) {
+    const tinja::Template templ("<table>{[<tr><td>{{id}}</td><td>{{name}}</td><td>{{value}}</td></tr>]}</table>");
+    const tinja::Template nested("<table>{[<tr><th>{{group}}</th></tr>{[<tr><td>{{id}}</td><td>{{name}}</td><td>{{value}}</td></tr>]}]}</table>");
+    for (size_t length = 1; length <= (isQuick ? 1000 : 1000000); length *= 10) {
+        std::vector<int> ids(length);
+        std::vector<double> values(length);
+        tinja::Strings names(length);
+        for (size_t i = 0; i < length; ++i) {
+            ids[i] = static_cast<int>(i);
+            values[i] = i * 0.25;
+            names[i] = "sensor " + std::to_string(i);
+        }
+        const std::vector<std::pair<std::string, size_t>> params { { "length", length } };
+
+        tinja::DataMap strings;
+        strings["id"] = tinja::Strings(length, "42");
+        strings["name"] = names;
+        strings["value"] = tinja::Strings(length, "1.25");
+        std::string doc;
+        suite.run("array/strings", params, 0, templ.renderedSize(strings), [&] {
+            doc.clear();
+            templ.renderTo(strings, tinja::StringSink { doc });
+        });
+
+        tinja::DataMap columns;
+        columns["id"] = tinja::Column(ids);
+        columns["name"] = tinja::Column(names);
+        columns["value"] = tinja::Column(values, 2);
+        suite.run("array/columns", params, 0, templ.renderedSize(columns), [&] {
+            doc.clear();
+            templ.renderTo(columns, tinja::StringSink { doc });
+        });
+
+        // Same rows in groups of up to 10, bound as jagged columns
+        tinja::Strings groups;
+        std::vector<size_t> offsets;
+        for (size_t i = 0; i < length; i += 10) {
+            groups.push_back("group " + std::to_string(i / 10));
+            offsets.push_back(i);
+        }
+        offsets.push_back(length);
+        tinja::DataMap jagged;
+        jagged["group"] = groups;
+        jagged["id"] = tinja::JaggedColumn(ids, offsets);
+        jagged["name"] = tinja::JaggedColumn(names, offsets);
+        jagged["value"] = tinja::JaggedColumn(tinja::Column(values, 2), offsets);
+        suite.run("array/nested", params, 0, nested.renderedSize(jagged), [&] {
+            doc.clear();
+            nested.renderTo(jagged, tinja::StringSink { doc });
+        });
+    }
+}
+
+} // namespace
+
+int main(int argc, char* argv[]) {
+    Options options;
+    for (int i = 1; i < argc; ++i) {
+        const std::string arg = argv[i];
+        if (arg == "--quick") {
+            options.isQuick = true;
+        } else if (arg == "--filter" && i + 1 < argc) {
+            options.filter = argv[++i];
+        } else if (arg == "--json" && i + 1 < argc) {
+            options.jsonPath = argv[++i];
+        } else {
+            std::cerr << "usage: " << argv[0] << " [--quick] [--filter <substring>] [--json <file>]" << std::endl;
+            return 1;
+        }
+    }
+
+    Suite suite(options);
+    benchmarkTemplates(suite, options.isQuick);
+    benchmarkArrays(suite, options.isQuick);
+    if (!suite.writeJson()) {
+        std::cerr << "tinja_bench: cannot write " << options.jsonPath << std::endl;
+        return 1;
+    }
+    return 0;
+}
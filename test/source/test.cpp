@@ -1,6 +1,15 @@
 #include <catch2/catch_test_macros.hpp>
 
 #include <tinja.hpp>
+#include <tinja_gzip.hpp>
+#include <tinja_mmap.hpp>
+#include <tinja_registry.hpp>
+#include <tinja_threads.hpp>
+
+#include <regex>
+#include <thread>
+
+#include <unistd.h>
 
 TEST_CASE("Texts", "[tinja]") {
     std::string str = "";
@@ -103,3 +112,1365 @@ TEST_CASE("Arrays", "[tinja]") {
     REQUIRE(tokens.at(4).get() == "Vc");
     REQUIRE(tokens.at(5).get() == "Vc");
 }
+
+TEST_CASE("Bound slots", "[tinja]") {
+    tinja::Template templ("{{A}} {[{{V}}{{B}}]}");
+    tinja::Template::Tokens tokens;
+    tinja::Schema schema { "B" };
+    templ.bind(schema);
+    REQUIRE(schema.size() == 3);
+    REQUIRE(schema.find("B") == 0);
+    REQUIRE(schema.find("C") == tinja::Schema::npos);
+
+    tinja::DataSlots data(schema);
+    templ.renderTo(data, tokens);
+    REQUIRE(tokens.size() == 1);
+    REQUIRE(tokens.front().get() == " ");
+
+    data["A"] = "a";
+    data["B"] = "-";
+    data[schema.find("V")] = tinja::Strings { "Va", "Vb" };
+    templ.renderTo(data, tokens);
+    REQUIRE(tokens.size() == 6);
+    REQUIRE(tokens.at(0).get() == "a");
+    REQUIRE(tokens.at(2).get() == "Va");
+    REQUIRE(tokens.at(3).get() == "-");
+    REQUIRE(tokens.at(4).get() == "Vb");
+    REQUIRE_THROWS(data["C"]);
+}
+
+TEST_CASE("Views", "[tinja]") {
+    const std::string str = "T{{V}}{[-{{A}}]}";
+    tinja::TemplateView templ;
+    tinja::TemplateView::Tokens tokens;
+    tinja::DataMap data;
+    REQUIRE(templ.parse(str) == 3);
+    data["V"] = "v";
+    data["A"] = tinja::Strings { "a", "b" };
+    templ.renderTo(data, tokens);
+    REQUIRE(tokens.size() == 6);
+    REQUIRE(tokens.at(0) == "T");
+    REQUIRE(tokens.at(0).data() == str.data());
+    REQUIRE(tokens.at(1) == "v");
+    REQUIRE(tokens.at(2) == "-");
+    REQUIRE(tokens.at(2).data() == str.data() + 8);
+    REQUIRE(tokens.at(5) == "b");
+
+    // Owned source survives the original string
+    std::string owned = "Hello {{V}}!";
+    REQUIRE(templ.parse(std::move(owned)) == 3);
+    owned = "changed";
+    auto copy = templ;
+    templ.parse("");
+    copy.renderTo(data, tokens);
+    REQUIRE(tokens.size() == 3);
+    REQUIRE(tokens.at(0) == "Hello ");
+    REQUIRE(tokens.at(2) == "!");
+
+    tinja::Schema schema;
+    copy.bind(schema);
+    tinja::DataSlots slots(schema);
+    slots["V"] = "w";
+    copy.renderTo(slots, tokens);
+    REQUIRE(tokens.at(1) == "w");
+
+    // Maps are looked up by views, without a key string per lookup
+    data["a_name_beyond_small_strings"] = "long";
+    REQUIRE(tinja::findData(data, std::string_view("a_name_beyond_small_strings")) == &data["a_name_beyond_small_strings"]);
+    REQUIRE(tinja::findData(data, std::string_view("missing")) == nullptr);
+    REQUIRE(tinja::TemplateView("{{a_name_beyond_small_strings}}").render(data) == "long");
+}
+
+TEST_CASE("Sinks", "[tinja]") {
+    tinja::Template templ("Hello {{V}}! {[{{A}},]}");
+    tinja::DataMap data;
+    data["V"] = "world";
+    data["A"] = tinja::Strings { "a", "", "c" };
+
+    std::string str;
+    templ.renderTo(data, tinja::StringSink { str });
+    REQUIRE(str == "Hello world! a,,c,");
+
+    size_t calls = 0;
+    str.clear();
+    templ.renderTo(data, [&](std::string_view token) {
+        REQUIRE(!token.empty());
+        ++calls;
+        str += token;
+    });
+    REQUIRE(str == "Hello world! a,,c,");
+    REQUIRE(calls == 8);
+
+    std::vector<std::string> chunks;
+    tinja::ChunkedSink<4, std::function<void(std::string_view)>> chunked([&](std::string_view chunk) {
+        chunks.emplace_back(chunk);
+    });
+    templ.renderTo(data, chunked);
+    chunked.flush();
+    REQUIRE(chunks.size() == 4);
+    REQUIRE(chunks.front() == "Hello ");
+    REQUIRE(chunks.at(1) == "world");
+    REQUIRE(chunks.at(2) == "! a,");
+    REQUIRE(chunks.back() == ",c,");
+    str.clear();
+    for (const auto& c : chunks) {
+        REQUIRE(c.size() >= 1);
+        str += c;
+    }
+    REQUIRE(str == "Hello world! a,,c,");
+}
+
+TEST_CASE("Iovecs", "[tinja]") {
+    tinja::Template templ("Hello {{V}}! {[{{A}},]}");
+    tinja::DataMap data;
+    data["V"] = "world";
+    data["A"] = tinja::Strings { "a", "", "c" };
+
+    int fds[2];
+    REQUIRE(pipe(fds) == 0);
+    std::vector<int> batches;
+    auto flush = [&](const iovec* iovs, int count) {
+        batches.push_back(count);
+        size_t size = 0;
+        for (int i = 0; i < count; ++i) {
+            size += iovs[i].iov_len;
+        }
+        REQUIRE(writev(fds[1], iovs, count) == static_cast<ssize_t>(size));
+    };
+    tinja::IovecSink<decltype(flush), 3> sink(flush);
+    templ.renderTo(data, sink);
+    sink.flush();
+    close(fds[1]);
+
+    std::string str(64, '\0');
+    str.resize(read(fds[0], str.data(), str.size()));
+    close(fds[0]);
+    REQUIRE(str == "Hello world! a,,c,");
+    REQUIRE(batches == std::vector<int> { 3, 3, 2 });
+}
+
+TEST_CASE("Rendered size", "[tinja]") {
+    tinja::Template templ("Hello {{V}}! {[{{A}}, ]}{[-]}{{X}}");
+    tinja::DataMap data;
+    REQUIRE(templ.renderedSize(data) == 9);
+    REQUIRE(templ.render(data) == "Hello ! -");
+
+    data["V"] = "world";
+    data["A"] = tinja::Strings { "a", "", "ccc" };
+    const auto str = templ.render(data);
+    REQUIRE(str == "Hello world! a, , ccc, -");
+    REQUIRE(templ.renderedSize(data) == str.size());
+
+    tinja::Schema schema;
+    templ.bind(schema);
+    tinja::DataSlots slots(schema);
+    slots["A"] = tinja::Strings { "bb" };
+    REQUIRE(templ.renderedSize(slots) == 13);
+    REQUIRE(templ.render(slots) == "Hello ! bb, -");
+}
+
+TEST_CASE("Programs", "[tinja]") {
+    tinja::Template templ("Hello {{V}}! {[{{A}}{{V}}, ]}{[-]}{[{{X}}]}.");
+    tinja::Program program(templ);
+    REQUIRE(program.ops().size() == 15);
+    tinja::Program::Tokens tokens;
+    tinja::DataMap data;
+    program.renderTo(data, tokens);
+    REQUIRE(tokens.size() == 4);
+    REQUIRE(tokens.at(2) == "-");
+
+    data["V"] = "world";
+    data["A"] = tinja::Strings { "a", "", "c" };
+    std::string str;
+    program.renderTo(data, tinja::StringSink { str });
+    REQUIRE(str == templ.render(data));
+    REQUIRE(str == "Hello world! aworld, world, cworld, -.");
+    data["a_name_beyond_small_strings"] = "long";
+    str.clear();
+    tinja::Program(tinja::Template("{{a_name_beyond_small_strings}}")).renderTo(data, tinja::StringSink { str });
+    REQUIRE(str == "long");
+
+    tinja::Schema schema;
+    program.bind(schema);
+    tinja::DataSlots slots(schema);
+    slots["V"] = "v";
+    slots["A"] = tinja::Strings { "b" };
+    slots["X"] = tinja::Strings { "x", "y" };
+    program.renderTo(slots, tokens);
+    REQUIRE(tokens.size() == 10);
+    REQUIRE(tokens.at(3) == "b");
+    REQUIRE(tokens.at(7) == "x");
+    REQUIRE(tokens.at(8) == "y");
+
+    // Slots of bound templates are taken over
+    tinja::Template bound("{{X}}");
+    bound.bind(schema);
+    tinja::Program boundProgram(bound);
+    str.clear();
+    boundProgram.renderTo(slots, tinja::StringSink { str });
+    REQUIRE(str == "x");
+}
+
+static constexpr char staticPage[] = "Hello {{V}}! {[{{A}}{{V}}, ]}{[-]}{[{{X}}]}{x}.";
+
+TEST_CASE("Static templates", "[tinja]") {
+    tinja::StaticTemplate<staticPage> templ;
+    tinja::StaticTemplate<staticPage>::Tokens tokens;
+    tinja::DataMap data;
+    templ.renderTo(data, tokens);
+    REQUIRE(tokens.size() == 4);
+    REQUIRE(tokens.at(0) == "Hello ");
+    REQUIRE(tokens.at(0).data() == staticPage);
+    REQUIRE(tokens.at(3) == "{x}.");
+
+    data["V"] = "world";
+    data["A"] = tinja::Strings { "a", "", "c" };
+    data["X"] = tinja::Strings { "x", "y" };
+    std::string str;
+    templ.renderTo(data, tinja::StringSink { str });
+    REQUIRE(str == "Hello world! aworld, world, cworld, -xy{x}.");
+
+    tinja::Schema schema;
+    templ.bind(schema);
+    REQUIRE(schema.size() == 3);
+    tinja::DataSlots slots(schema);
+    slots["V"] = "v";
+    slots["A"] = tinja::Strings { "b" };
+    str.clear();
+    templ.renderTo(slots, tinja::StringSink { str });
+    REQUIRE(str == "Hello v! bv, -{x}.");
+}
+
+TEST_CASE("Braces", "[tinja]") {
+    tinja::Template templ;
+    tinja::DataMap data;
+    data["V"] = "v";
+    data["A"] = tinja::Strings { "a", "b" };
+
+    std::string str = "<style>.a{color:red}.b{margin:0}</style>{{V}}{}{[{{A}}]}";
+    REQUIRE(templ.parse(str) == 4);
+    REQUIRE(templ.render(data) == "<style>.a{color:red}.b{margin:0}</style>v{}ab");
+
+    // Delimiters at every position relative to the scanned blocks
+    for (size_t i = 0; i < 70; ++i) {
+        std::string css(i, 'x');
+        for (size_t k = 0; k+1 < i; k += 3) {
+            css[k] = '{';
+        }
+        str = css + "{{V}}" + css + "{[{{A}}]}" + css;
+        REQUIRE(templ.parse(str) == (i ? 5 : 2));
+        REQUIRE(templ.render(data) == css + "v" + css + "ab" + css);
+    }
+
+    for (size_t i = 0; i < 70; ++i) {
+        str = std::string(i, ' ') + "{{V}";
+        REQUIRE(templ.parse(str) == (i ? 1 : 0));
+    }
+}
+
+TEST_CASE("Shared templates", "[tinja]") {
+    tinja::SharedTemplate<tinja::Template> shared(tinja::Template("A{{V}}"));
+    tinja::DataMap data;
+    data["V"] = "v";
+    REQUIRE(shared.render(data) == "Av");
+
+    std::atomic<bool> done = false;
+    std::atomic<size_t> renders = 0;
+    std::atomic<size_t> invalid = 0;
+    std::vector<std::thread> readers;
+    for (int i = 0; i < 4; ++i) {
+        readers.emplace_back([&] {
+            std::string str;
+            while (!done) {
+                const auto view = shared.render(data);
+                str.clear();
+                shared.renderTo(data, tinja::StringSink { str });
+                if ((view != "Av" && view != "Bv") || (str != "Av" && str != "Bv")) {
+                    ++invalid;
+                }
+                ++renders;
+            }
+        });
+    }
+    for (int i = 0; i < 1000 || renders < 1000; ++i) {
+        shared.store(tinja::Template(i % 2 ? "A{{V}}" : "B{{V}}"));
+    }
+    done = true;
+    for (auto& reader : readers) {
+        reader.join();
+    }
+    REQUIRE(invalid == 0);
+    REQUIRE(shared.get()->render(data).size() == 2);
+
+    shared.store(tinja::Template("C{{V}}"));
+    REQUIRE(shared.render(data) == "Cv");
+
+    // Alternating templates keep their own snapshots. A render from a sink, even of the same
+    // template after a reload, does not release the snapshot being rendered.
+    tinja::SharedTemplate<tinja::Template> other(tinja::Template("<{{V}}>"));
+    std::string str;
+    for (int i = 0; i < 3; ++i) {
+        shared.renderTo(data, tinja::StringSink { str });
+        other.renderTo(data, tinja::StringSink { str });
+    }
+    REQUIRE(str == "Cv<v>Cv<v>Cv<v>");
+    str.clear();
+    shared.renderTo(data, [&](std::string_view token) {
+        str += token;
+        if (token == "C") {
+            shared.store(tinja::Template("D{{V}}"));
+            other.renderTo(data, tinja::StringSink { str });
+            shared.renderTo(data, tinja::StringSink { str });
+        }
+    });
+    REQUIRE(str == "C<v>Dvv");
+    REQUIRE(shared.render(data) == "Dv");
+
+    // Caches of rendering threads do not keep reloaded or destroyed templates alive
+    const std::weak_ptr<const tinja::Template> reloaded = shared.get();
+    shared.store(tinja::Template("E{{V}}"));
+    REQUIRE(reloaded.expired());
+    REQUIRE(shared.render(data) == "Ev");
+    std::weak_ptr<const tinja::Template> destroyed;
+    {
+        tinja::SharedTemplate<tinja::Template> scoped(tinja::Template("F{{V}}"));
+        REQUIRE(scoped.render(data) == "Fv");
+        destroyed = scoped.get();
+    }
+    REQUIRE(destroyed.expired());
+}
+
+TEST_CASE("Registry", "[tinja]") {
+    tinja::TemplateRegistry registry;
+    tinja::DataMap data;
+    data["V"] = "v";
+    data["A"] = tinja::Strings { "a", "b" };
+
+    registry.set("header", "<h>{{V}}</h>");
+    registry.set("row", "<r>{{A}}</r>");
+    registry.set("page", "{{>header}}{[{{>row}}]}{{>footer}}.");
+    registry.set("other", "{{>row}}");
+    REQUIRE(registry.get("page")->render(data) == "<h>v</h><r>a</r><r>b</r>.");
+    REQUIRE(registry.parseCount() == 3);
+
+    // Unchanged content is not parsed again
+    const auto page = registry.get("page");
+    const auto other = registry.get("other");
+    REQUIRE_FALSE(registry.set("header", "<h>{{V}}</h>"));
+    REQUIRE(registry.get("page") == page);
+    REQUIRE(registry.parseCount() == 4);
+
+    // Changed fragment only invalidates templates including it
+    REQUIRE(registry.set("footer", "<f/>"));
+    REQUIRE(registry.get("page")->render(data) == "<h>v</h><r>a</r><r>b</r><f/>.");
+    REQUIRE(registry.get("other") == other);
+    REQUIRE(registry.parseCount() == 6);
+
+    // Reverting content hits the cache
+    const auto page2 = registry.get("page");
+    registry.set("header", "<H>{{V}}</H>");
+    REQUIRE(registry.get("page") != page2);
+    registry.set("header", "<h>{{V}}</h>");
+    REQUIRE(registry.get("page") == page2);
+    // (the previous header is kept by the cached page)
+    REQUIRE(registry.parseCount() == 8);
+
+    // Results no longer used are dropped from the cache on updates
+    for (int i = 0; i < 1000; ++i) {
+        registry.set("footer", "<f>" + std::to_string(i) + "</f>");
+        REQUIRE(registry.get("page")->render(data).size() > 0);
+    }
+    REQUIRE(registry.cacheSize() < 16);
+
+    registry.set("a", "{{>b}}");
+    registry.set("b", "{{>a}}");
+    REQUIRE_THROWS_AS(registry.get("a"), std::runtime_error);
+    REQUIRE_THROWS_AS(registry.get("unknown"), std::out_of_range);
+
+    // Without resolver, partials are regular variables
+    tinja::Template templ("{{>V}}");
+    data[">V"] = "x";
+    REQUIRE(templ.render(data) == "x");
+}
+
+TEST_CASE("Incremental", "[tinja]") {
+    tinja::Template templ("<p>{{V}}</p><p>{{P}}</p>{[<li>{{A}}</li>]}<p>{{V}}</p>");
+    tinja::Schema schema;
+    templ.bind(schema);
+    tinja::TrackedSlots data(schema);
+    REQUIRE(data.set("V", "1"));
+    REQUIRE(data.set("P", "2"));
+    REQUIRE(data.set("A", tinja::Strings { "a", "b" }));
+
+    tinja::IncrementalRenderer<tinja::Template> renderer(templ);
+    const auto concat = [&] {
+        std::string str;
+        for (const auto& t : renderer.tokens()) {
+            str += t.get();
+        }
+        return str;
+    };
+    renderer.update(data);
+    REQUIRE(concat() == templ.render(data.slots()));
+    REQUIRE(data.changes().empty());
+
+    // Unchanged data is not marked
+    REQUIRE_FALSE(data.set("P", "2"));
+    REQUIRE_FALSE(data.set("A", tinja::Strings { "a", "b" }));
+    renderer.update(data);
+    REQUIRE(renderer.lastPatchCount() == 0);
+
+    // Only the two nodes of V are patched
+    REQUIRE(data.set("V", "one"));
+    renderer.update(data);
+    REQUIRE(renderer.lastPatchCount() == 2);
+    REQUIRE(concat() == "<p>one</p><p>2</p><li>a</li><li>b</li><p>one</p>");
+
+    // Changed array length shifts subsequent spans
+    data.set("A", tinja::Strings { "x", "y", "z" });
+    renderer.update(data);
+    REQUIRE(renderer.lastPatchCount() == 1);
+    REQUIRE(concat() == "<p>one</p><p>2</p><li>x</li><li>y</li><li>z</li><p>one</p>");
+    data.set("A", tinja::Strings {});
+    data.set("V", "1");
+    renderer.update(data);
+    REQUIRE(concat() == "<p>1</p><p>2</p><p>1</p>");
+
+    data.reset(schema.find("P"));
+    renderer.update(data);
+    REQUIRE(concat() == templ.render(data.slots()));
+
+    // Referenced data is always marked, touch() marks in place modifications
+    const std::string v = "ref";
+    REQUIRE(data.set("V", std::cref(v)));
+    REQUIRE(data.set("V", std::cref(v)));
+    data.touch(schema.find("P"));
+    REQUIRE(data.changes().size() == 2);
+}
+
+TEST_CASE("Deltas", "[tinja]") {
+    tinja::TemplateView templ("<p>{{V}}</p>{[<li>{{A}}</li>]}<p>{{P}}</p>");
+    tinja::Schema schema;
+    templ.bind(schema);
+    tinja::TrackedSlots data(schema);
+    data.set("V", "1");
+    data.set("P", "2");
+    data.set("A", tinja::Strings { "a", "b" });
+
+    int fds[2];
+    REQUIRE(pipe(fds) == 0);
+    tinja::IncrementalRenderer<tinja::TemplateView> renderer(templ);
+    std::string records;
+    const auto push = [&] {
+        records.clear();
+        renderer.update(data, [&](size_t node, std::string_view value) {
+            tinja::appendDelta(records, node, value);
+        });
+        REQUIRE(write(fds[1], records.data(), records.size()) == ssize_t(records.size()));
+        return records.size();
+    };
+
+    // Client applies records received from the pipe to its copy of the page
+    std::vector<std::string> page;
+    std::string received;
+    const auto receive = [&] {
+        char buffer[64];
+        const auto n = read(fds[0], buffer, sizeof(buffer));
+        REQUIRE(n > 0);
+        received.append(buffer, n);
+        size_t pos = 0, node = 0, count = 0;
+        std::string_view value;
+        while (tinja::readDelta(received, pos, node, value)) {
+            page.resize(std::max(page.size(), node + 1));
+            page[node] = value;
+            ++count;
+        }
+        received.erase(0, pos);
+        std::string str;
+        for (const auto& s : page) {
+            str += s;
+        }
+        return std::make_pair(count, str);
+    };
+
+    push();
+    REQUIRE(receive() == std::make_pair(size_t(7), templ.render(data.slots())));
+
+    data.set("V", "one");
+    REQUIRE(push() == 5);
+    REQUIRE(receive() == std::make_pair(size_t(1), std::string("<p>one</p><li>a</li><li>b</li><p>2</p>")));
+
+    data.set("A", tinja::Strings { "c" });
+    data.set("P", "2");
+    push();
+    REQUIRE(receive() == std::make_pair(size_t(1), std::string("<p>one</p><li>c</li><p>2</p>")));
+
+    // Marked slots rendering the same bytes push no records
+    const std::string one = "one";
+    const std::vector<std::string> letters { "c" };
+    REQUIRE(data.set("V", std::string_view(one)));
+    REQUIRE(data.set("A", tinja::Column(letters)));
+    REQUIRE(push() == 0);
+    REQUIRE(renderer.lastPatchCount() == 2);
+    data.set("A", tinja::Strings { "c", "d" });
+    push();
+    REQUIRE(receive() == std::make_pair(size_t(1), std::string("<p>one</p><li>c</li><li>d</li><p>2</p>")));
+
+    // Values of the same length and replaced arrays are compared to the bytes last pushed
+    data.set("V", "two");
+    push();
+    REQUIRE(receive() == std::make_pair(size_t(1), std::string("<p>two</p><li>c</li><li>d</li><p>2</p>")));
+    data.set("V", "six");
+    data.set("A", tinja::Strings { "e", "f" });
+    push();
+    REQUIRE(receive() == std::make_pair(size_t(2), std::string("<p>six</p><li>e</li><li>f</li><p>2</p>")));
+    data.set("A", tinja::Strings { "e", "f" });
+    REQUIRE(push() == 0);
+
+    // Partial records stay buffered until complete
+    std::string big;
+    tinja::appendDelta(big, 300, std::string(200, 'x'));
+    size_t pos = 0, node = 0;
+    std::string_view value;
+    REQUIRE_FALSE(tinja::readDelta(std::string_view(big).substr(0, 100), pos, node, value));
+    REQUIRE(pos == 0);
+    REQUIRE(tinja::readDelta(big, pos, node, value));
+    REQUIRE(node == 300);
+    REQUIRE(value.size() == 200);
+    REQUIRE(pos == big.size());
+
+    close(fds[0]);
+    close(fds[1]);
+}
+
+TEST_CASE("Columns", "[tinja]") {
+    const std::vector<int> ints { 1, -20, 300 };
+    const std::vector<double> doubles { 0.5, 52.25, -1.0 };
+    const std::vector<uint64_t> big { 18446744073709551615ull };
+    tinja::DataMap data;
+    data["I"] = tinja::Column(ints);
+    data["D"] = tinja::Column(doubles, 1);
+    data["S"] = tinja::Column(doubles);
+    data["N"] = "n";
+
+    static constexpr char page[] = "{[<{{I}}|{{D}}|{{S}}|{{N}}>]}";
+    const std::string expected = "<1|0.5|0.5|n><-20|52.2|52.25|n><300|-1.0|-1|n>";
+    tinja::Template templ(page);
+    REQUIRE(templ.render(data) == expected);
+    REQUIRE(templ.renderedSize(data) == expected.size());
+
+    tinja::Template::Tokens tokens;
+    templ.renderTo(data, tokens);
+    std::string str;
+    for (const auto& t : tokens) {
+        str += t.get();
+    }
+    REQUIRE(str == expected);
+
+    tinja::TemplateView view(page);
+    tinja::TemplateView::Tokens viewTokens;
+    view.renderTo(data, viewTokens);
+    REQUIRE(viewTokens.size() == tokens.size());
+    REQUIRE(viewTokens[1] == "1");
+
+    tinja::Schema schema;
+    tinja::Program program(templ);
+    program.bind(schema);
+    tinja::DataSlots slots(schema);
+    slots["I"] = tinja::Column(ints);
+    slots["D"] = tinja::Column(doubles, 1);
+    slots["S"] = tinja::Column(doubles);
+    slots["N"] = "n";
+    std::string programStr;
+    program.renderTo(slots, tinja::StringSink { programStr });
+    REQUIRE(programStr == expected);
+
+    std::string staticStr;
+    tinja::StaticTemplate<page>().renderTo(data, tinja::StringSink { staticStr });
+    REQUIRE(staticStr == expected);
+
+    // Columns span multiple arena chunks
+    std::vector<int64_t> many(5000);
+    for (size_t i = 0; i < many.size(); ++i) {
+        many[i] = static_cast<int64_t>(i) * 1000003;
+    }
+    data["I"] = tinja::Column(many.data(), many.size());
+    data.erase("D");
+    data.erase("S");
+    tinja::Template manyTempl("{[{{I}},]}");
+    std::string manyExpected;
+    for (const auto v : many) {
+        manyExpected += std::to_string(v) + ",";
+    }
+    REQUIRE(manyTempl.render(data) == manyExpected);
+    manyTempl.renderTo(data, tokens);
+    str.clear();
+    for (const auto& t : tokens) {
+        str += t.get();
+    }
+    REQUIRE(str == manyExpected);
+
+    data["B"] = tinja::Column(big);
+    REQUIRE(tinja::Template("{{B}}").render(data) == "18446744073709551615");
+
+    // Columns of temporaries would dangle
+    struct Sample {
+        int value;
+    };
+    STATIC_REQUIRE(!std::is_constructible_v<tinja::Column, std::vector<int>&&>);
+    STATIC_REQUIRE(!std::is_constructible_v<tinja::Column, std::vector<Sample>&&, int Sample::*>);
+    STATIC_REQUIRE(std::is_constructible_v<tinja::Column, const std::vector<int>&>);
+}
+
+TEST_CASE("Spans", "[tinja]") {
+    struct Sample {
+        double temperature;
+        int power;
+        std::string_view state;
+        std::string label;
+    };
+    const std::vector<Sample> samples {
+        { 52.3, 56, "on", "a" },
+        { 52.4, 0, "off", "b" }
+    };
+    const std::string shared = "shared";
+
+    tinja::DataMap data;
+    data["T"] = tinja::Column(samples, &Sample::temperature, 1);
+    data["P"] = tinja::Column(samples, &Sample::power);
+    data["S"] = tinja::Column(samples, &Sample::state);
+    data["L"] = tinja::Column(samples, &Sample::label);
+    data["V"] = std::string_view(shared);
+    data["E"] = std::string_view();
+
+    static constexpr char page[] = "{{V}}{{E}}:{[<{{T}} {{P}} {{S}} {{L}} {{V}}>]}";
+    const std::string expected = "shared:<52.3 56 on a shared><52.4 0 off b shared>";
+    tinja::Template templ(page);
+    REQUIRE(templ.render(data) == expected);
+    REQUIRE(templ.renderedSize(data) == expected.size());
+
+    // Views are passed on without copies
+    tinja::TemplateView view(page);
+    tinja::TemplateView::Tokens tokens;
+    view.renderTo(data, tokens);
+    REQUIRE(tokens[0].data() == shared.data());
+    REQUIRE(tokens[7].data() == samples[0].state.data());
+    REQUIRE(tokens[9].data() == samples[0].label.data());
+
+    std::string staticStr;
+    tinja::StaticTemplate<page>().renderTo(data, tinja::StringSink { staticStr });
+    REQUIRE(staticStr == expected);
+
+    std::string programStr;
+    tinja::Program(templ).renderTo(data, tinja::StringSink { programStr });
+    REQUIRE(programStr == expected);
+
+    // Empty arrays of structs
+    const std::vector<Sample> none;
+    data["T"] = tinja::Column(none, &Sample::temperature);
+    REQUIRE(templ.render(data) == "shared:");
+}
+
+TEST_CASE("Arenas", "[tinja]") {
+    const std::string source = "<html><head><title>{{T}}</title></head><body><ul class=\"list\">"
+                               "{[<li class=\"item\">{{A}}<span class=\"index\">{{B}}</span></li>]}"
+                               "</ul></body></html>";
+    tinja::DataMap data;
+    data["T"] = "title";
+    data["A"] = tinja::Strings { "a", "b" };
+    data["B"] = tinja::Strings { "1", "2" };
+    const auto expected = tinja::Template(source).render(data);
+
+    std::array<std::byte, 8192> buffer;
+    std::pmr::monotonic_buffer_resource arena(buffer.data(), buffer.size(), std::pmr::null_memory_resource());
+
+    // Any allocation outside of the arena from a default constructed resource throws
+    const auto previous = std::pmr::set_default_resource(std::pmr::null_memory_resource());
+    tinja::PmrTemplate templ(source, 0, &arena);
+    tinja::PmrTemplate::Tokens tokens(&arena);
+    templ.renderTo(data, tokens);
+    tinja::TemplateView view(source, 0, &arena);
+    tinja::Schema schema;
+    view.bind(schema);
+    tinja::DataSlots slots(schema, &arena);
+    std::pmr::string out(&arena);
+    slots["T"] = std::string_view("title");
+    view.renderTo(slots, [&](std::string_view str) { out.append(str); });
+    std::pmr::set_default_resource(previous);
+
+    std::string str;
+    for (const auto& t : tokens) {
+        str += t;
+    }
+    REQUIRE(str == expected);
+    REQUIRE(out == "<html><head><title>title</title></head><body><ul class=\"list\"></ul></body></html>");
+    REQUIRE(templ.resource() == &arena);
+
+    // Copies use the default resource
+    const auto copy = templ;
+    REQUIRE(copy.resource() == std::pmr::get_default_resource());
+    REQUIRE(copy.render(data) == expected);
+
+    // Expanded partials are copied into the arena as well
+    const tinja::PmrTemplate list("<ul class=\"list\">{[<li class=\"item\">{{A}}<span class=\"index\">{{B}}</span></li>]}</ul>");
+    std::array<std::byte, 8192> partialBuffer;
+    std::pmr::monotonic_buffer_resource partialArena(partialBuffer.data(), partialBuffer.size(), std::pmr::null_memory_resource());
+    std::pmr::set_default_resource(std::pmr::null_memory_resource());
+    tinja::PmrTemplate page(0, &partialArena);
+    page.parse("<html><head><title>{{T}}</title></head><body>{{>list}}</body></html>", [&](tinja::StringView name) {
+        return name == "list" ? &list : nullptr;
+    });
+    std::pmr::set_default_resource(previous);
+    REQUIRE(page.render(data) == expected);
+}
+
+TEST_CASE("Parallel", "[tinja]") {
+    std::vector<int> values(10000);
+    for (size_t i = 0; i < values.size(); ++i) {
+        values[i] = static_cast<int>(i);
+    }
+    tinja::Strings strings(values.size() / 2, "s");
+    tinja::DataMap data;
+    data["V"] = tinja::Column(values);
+    data["S"] = strings;
+    data["T"] = "title";
+    tinja::Template templ("<h>{{T}}</h>{[<td>{{V}}</td>]}<p>{[{{S}}]}</p>{[{{T}}]}");
+    const auto expected = templ.render(data);
+
+    tinja::ThreadPool pool(3, 100);
+    REQUIRE(pool.chunkCount(99) == 1);
+    REQUIRE(pool.chunkCount(1000) == 10);
+    REQUIRE(pool.chunkCount(100000) == 16);
+    REQUIRE(templ.render(data, pool) == expected);
+
+    tinja::Template::Tokens tokens;
+    templ.renderTo(data, tokens, pool);
+    std::string str;
+    for (const auto& t : tokens) {
+        str += t.get();
+    }
+    REQUIRE(str == expected);
+    // One token per chunk
+    REQUIRE(tokens.size() == 3 + 16 + 2 + 16 + 1);
+
+    tinja::Schema schema;
+    templ.bind(schema);
+    tinja::DataSlots slots(schema);
+    slots["V"] = tinja::Column(values);
+    slots["S"] = strings;
+    slots["T"] = "title";
+    std::string out;
+    templ.renderTo(slots, tinja::StringSink { out }, pool);
+    REQUIRE(out == expected);
+
+    // Concurrent renders share the pool
+    std::vector<std::thread> threads;
+    std::atomic<size_t> matches = 0;
+    for (int t = 0; t < 4; ++t) {
+        threads.emplace_back([&] {
+            for (int i = 0; i < 10; ++i) {
+                matches += templ.render(data, pool) == expected;
+            }
+        });
+    }
+    for (auto& thread : threads) {
+        thread.join();
+    }
+    REQUIRE(matches == 40);
+
+    // Exceptions of chunks are rethrown
+    REQUIRE_THROWS_AS(pool.run(10, [](size_t i) { if (i == 7) throw std::runtime_error("chunk"); }), std::runtime_error);
+
+    // Nested runs from tasks run inline instead of deadlocking
+    std::atomic<size_t> renders = 0;
+    pool.run(8, [&](size_t) {
+        renders += templ.render(data, pool) == expected;
+    });
+    REQUIRE(renders == 8);
+
+    tinja::ThreadPool serial(0, 1);
+    REQUIRE(serial.chunkCount(values.size()) == 1);
+    REQUIRE(templ.render(data, serial) == expected);
+}
+
+TEST_CASE("Batches", "[tinja]") {
+    tinja::Template templ("<h>{{N}}</h>{[<td>{{V}}</td>]}{{M}}");
+    std::vector<tinja::DataMap> devices(100);
+    std::vector<std::string> expected;
+    for (size_t i = 0; i < devices.size(); ++i) {
+        devices[i]["N"] = "device" + std::to_string(i);
+        devices[i]["V"] = tinja::Strings(i % 4, std::to_string(i));
+        expected.push_back(templ.render(devices[i]));
+    }
+
+    tinja::Batch batch;
+    templ.renderBatch(devices, batch);
+    REQUIRE(batch.size() == devices.size());
+    for (size_t i = 0; i < batch.size(); ++i) {
+        REQUIRE(batch[i] == expected[i]);
+    }
+
+    // Documents are appended
+    tinja::ThreadPool pool(3);
+    templ.renderBatch(devices, batch, &pool);
+    REQUIRE(batch.size() == 2 * devices.size());
+    REQUIRE(batch.offsets().back() == batch.text().size());
+    for (size_t i = 0; i < devices.size(); ++i) {
+        REQUIRE(batch[devices.size() + i] == expected[i]);
+    }
+
+    batch.clear();
+    REQUIRE(batch.size() == 0);
+    REQUIRE(batch.text().empty());
+
+    tinja::Schema schema;
+    templ.bind(schema);
+    std::vector<tinja::DataSlots> slots;
+    for (const auto& device : devices) {
+        auto& deviceSlots = slots.emplace_back(schema);
+        deviceSlots["N"] = device.at("N");
+        deviceSlots["V"] = device.at("V");
+    }
+    templ.renderBatch(slots, batch, &pool);
+    REQUIRE(batch.size() == devices.size());
+    REQUIRE(batch[42] == expected[42]);
+
+    // Templates bound to another schema still render maps
+    tinja::Schema other { "X", "Y" };
+    templ.bind(other);
+    batch.clear();
+    templ.renderBatch(devices, batch);
+    REQUIRE(batch[99] == expected[99]);
+
+    // Variables of streamed templates and of expanded partials resolve their keys like render()
+    tinja::Template streamed;
+    tinja::StreamParser<tinja::Template> parser(streamed);
+    parser.feed("{{N}}{[<td>{{V}}");
+    parser.feed("</td>]}{{N}}");
+    parser.finish();
+    batch.clear();
+    streamed.renderBatch(devices, batch);
+    for (size_t i = 0; i < devices.size(); ++i) {
+        REQUIRE(batch[i] == streamed.render(devices[i]));
+    }
+
+    const tinja::TemplateView header("<h>{{N}}</h>");
+    tinja::TemplateView view;
+    view.parse("{{>header}}{[{{V}}{{N}}]}", [&](tinja::StringView name) {
+        return name == "header" ? &header : nullptr;
+    });
+    batch.clear();
+    view.renderBatch(devices, batch, &pool);
+    for (size_t i = 0; i < devices.size(); ++i) {
+        REQUIRE(batch[i] == view.render(devices[i]));
+    }
+    REQUIRE(batch[3] == "<h>device3</h>3device33device33device3");
+}
+
+TEST_CASE("Images", "[tinja]") {
+    tinja::DataMap data;
+    data["V"] = "v";
+    data["A"] = tinja::Strings { "a", "b" };
+    data["B"] = tinja::Strings { "1", "2" };
+    const tinja::Template templ("<p>{{V}}</p>{[<li>{{A}}</li>]}{[{{B}}]}");
+    const tinja::Program program(templ);
+    const auto image = program.serialize();
+    REQUIRE(image.size() == sizeof(tinja::Program::ImageHeader) + program.ops().size() * sizeof(tinja::Program::Op) + program.text().size());
+
+    // Flash resident arrays must be aligned like ops
+    std::vector<uint32_t> flash((image.size() + 3) / 4);
+    std::memcpy(flash.data(), image.data(), image.size());
+    const auto viewed = tinja::Program::view(flash.data(), image.size());
+    REQUIRE(viewed.ops().data == reinterpret_cast<const tinja::Program::Op*>(reinterpret_cast<const char*>(flash.data()) + sizeof(tinja::Program::ImageHeader)));
+    std::string expected, str;
+    program.renderTo(data, tinja::StringSink { expected });
+    viewed.renderTo(data, tinja::StringSink { str });
+    REQUIRE(str == expected);
+    REQUIRE(viewed.serialize() == image);
+
+    // Binding copies the image
+    auto bound = viewed;
+    tinja::Schema schema;
+    bound.bind(schema);
+    REQUIRE(bound.ops().data != viewed.ops().data);
+    tinja::DataSlots slots(schema);
+    slots["V"] = "v";
+    slots["A"] = tinja::Strings { "a", "b" };
+    slots["B"] = tinja::Strings { "1", "2" };
+    str.clear();
+    bound.renderTo(slots, tinja::StringSink { str });
+    REQUIRE(str == expected);
+
+    // Memory mapped file
+    char path[] = "/tmp/tinja_imageXXXXXX";
+    const auto fd = mkstemp(path);
+    REQUIRE(fd >= 0);
+    REQUIRE(write(fd, image.data(), image.size()) == ssize_t(image.size()));
+    close(fd);
+    {
+        tinja::MappedFile file(path);
+        const auto mapped = tinja::Program::view(file.data(), file.size());
+        str.clear();
+        mapped.renderTo(data, tinja::StringSink { str });
+        REQUIRE(str == expected);
+    }
+    unlink(path);
+    REQUIRE_THROWS_AS(tinja::MappedFile(path), std::runtime_error);
+
+    // Invalid images
+    const auto viewCopy = [&](std::string bytes) {
+        std::vector<uint32_t> buffer((bytes.size() + 3) / 4);
+        std::memcpy(buffer.data(), bytes.data(), bytes.size());
+        return tinja::Program::view(buffer.data(), bytes.size());
+    };
+    REQUIRE_NOTHROW(viewCopy(image));
+    REQUIRE_THROWS_AS(viewCopy(image.substr(0, 10)), std::invalid_argument);
+    REQUIRE_THROWS_AS(viewCopy(image.substr(0, image.size() - 1)), std::invalid_argument);
+    auto broken = image;
+    broken[0] = 'X';
+    REQUIRE_THROWS_AS(viewCopy(broken), std::invalid_argument);
+    broken = image;
+    broken[4] = tinja::Program::imageVersion + 1;
+    REQUIRE_THROWS_AS(viewCopy(broken), std::invalid_argument);
+    // Unknown flags
+    broken = image;
+    broken[sizeof(tinja::Program::ImageHeader) + offsetof(tinja::Program::Op, flags)] = 2;
+    REQUIRE_THROWS_AS(viewCopy(broken), std::invalid_argument);
+    // Text op exceeding text
+    broken = image;
+    const uint32_t hugeSize = 1000;
+    std::memcpy(&broken[sizeof(tinja::Program::ImageHeader) + offsetof(tinja::Program::Op, b)], &hugeSize, 4);
+    REQUIRE_THROWS_AS(viewCopy(broken), std::invalid_argument);
+    // LoopBegin (op 3) pointing to a wrong LoopEnd
+    broken = image;
+    const uint32_t wrongEnd = 4;
+    REQUIRE(program.ops()[3].code == tinja::Program::OpCode::LoopBegin);
+    std::memcpy(&broken[sizeof(tinja::Program::ImageHeader) + 3 * sizeof(tinja::Program::Op) + offsetof(tinja::Program::Op, a)], &wrongEnd, 4);
+    REQUIRE_THROWS_AS(viewCopy(broken), std::invalid_argument);
+    REQUIRE_THROWS_AS(tinja::Program::view(reinterpret_cast<const char*>(flash.data()) + 1, image.size()), std::invalid_argument);
+}
+
+TEST_CASE("Streams", "[tinja]") {
+    tinja::DataMap data;
+    data["V"] = "v";
+    data["{V"] = "w";
+    data["A"] = tinja::Strings { "a", "b" };
+    const std::vector<std::string> sources {
+        "", "T", "{", "{{", "{{V", "{{V}", "{{V}}", "a{{V}}b", "{{}}x", "{{{V}}}", "}}{{V}}]}",
+        "a{{V", "a{{Vxyz", "a{{V}x}", "{[", "{[]}", "{[{{A}}]}", "x{[<{{A}}>]}y{{V}}z",
+        "{[{{A}}", "{[{{A}}]", "{[{{A}}{[{{V}}]}]}", "{x{y}z{", "css{a:b}{{V}}{c:d}", "{{V}}{{V}}{["
+    };
+    for (const auto& source : sources) {
+        tinja::Template expected;
+        const auto expectedCount = expected.parse(source);
+        for (size_t chunkSize = 1; chunkSize <= std::max<size_t>(1, source.size()); ++chunkSize) {
+            tinja::Template templ("{{stale}}");
+            tinja::StreamParser<tinja::Template> parser(templ);
+            for (size_t pos = 0; pos < source.size(); pos += chunkSize) {
+                parser.feed(std::string_view(source).substr(pos, chunkSize));
+            }
+            CAPTURE(source, chunkSize);
+            REQUIRE(parser.finish() == expectedCount);
+            REQUIRE(templ.render(data) == expected.render(data));
+            REQUIRE(templ.renderedSize(data) == expected.renderedSize(data));
+        }
+    }
+
+    // Only the current node is buffered
+    std::string chunk;
+    for (int i = 0; i < 100; ++i) {
+        chunk += "<p>{{V}}</p>";
+    }
+    tinja::Template templ;
+    tinja::StreamParser<tinja::Template> parser(templ);
+    size_t maxBuffered = 0;
+    for (int i = 0; i < 100; ++i) {
+        parser.feed(chunk);
+        maxBuffered = std::max(maxBuffered, parser.bufferedSize());
+    }
+    REQUIRE(parser.finish() == 20001);
+    REQUIRE(maxBuffered < 16);
+}
+
+TEST_CASE("Minify", "[tinja]") {
+    tinja::DataMap data;
+    data["V"] = "  <v>  ";
+    data["A"] = tinja::Strings { " a ", " b " };
+    const std::vector<std::string> sources {
+        "", " ", "<p> </p>", "  <p>\n\t<b> x </b>  y  </p>  ", "a > b < c", "> <", ">\r\n\f\v<",
+        "<p> {{V}} </p>", "<p>\n  {{V}}\n</p>\n", "<ul>\n{[  <li> {{A}} </li>\n]}\n</ul>", "{{ V }}",
+        "<td>{{V}}</td> <td> {{V}}</td>\n  <tr>{[ {{A}} ]}</tr>"
+    };
+    for (const auto& source : sources) {
+        // Reference: regex replace of the whole source (equal, as long as variables have no <>)
+        auto minified = std::regex_replace(source, std::regex("\\s+<"), "<");
+        minified = std::regex_replace(minified, std::regex(">\\s+"), ">");
+        const auto expected = tinja::Template(minified).render(data);
+        CAPTURE(source);
+
+        tinja::Template templ;
+        templ.parse(source, { true });
+        REQUIRE(templ.render(data) == expected);
+        REQUIRE(templ.renderedSize(data) == expected.size());
+
+        tinja::TemplateView view;
+        view.parse(source, { true });
+        REQUIRE(view.render(data) == expected);
+        REQUIRE(view.renderedSize(data) == expected.size());
+
+        tinja::PmrTemplate pmr;
+        pmr.parse(source, { true });
+        REQUIRE(pmr.render(data) == expected);
+
+        tinja::Template streamed;
+        tinja::StreamParser<tinja::Template> parser(streamed, { true });
+        for (size_t pos = 0; pos < source.size(); pos += 3) {
+            parser.feed(std::string_view(source).substr(pos, 3));
+        }
+        parser.finish();
+        REQUIRE(streamed.render(data) == expected);
+    }
+
+    // Variables are kept as is
+    tinja::DataMap spaced;
+    spaced["> V <"] = "v";
+    tinja::Template templ;
+    templ.parse("<p> {{> V <}} </p>", { true });
+    REQUIRE(templ.render(spaced) == "<p>v</p>");
+    REQUIRE(templ.parse("<p>  </p>", { true }) == 1);
+}
+
+static std::string gunzip(const std::string& in) {
+    z_stream stream {};
+    REQUIRE(inflateInit2(&stream, 16 + MAX_WBITS) == Z_OK);
+    std::string out(1 << 16, '\0');
+    stream.next_in = reinterpret_cast<Bytef*>(const_cast<char*>(in.data()));
+    stream.avail_in = static_cast<uInt>(in.size());
+    int result = Z_OK;
+    while (result == Z_OK) {
+        if (stream.total_out == out.size()) {
+            out.resize(out.size() * 2);
+        }
+        stream.next_out = reinterpret_cast<Bytef*>(out.data() + stream.total_out);
+        stream.avail_out = static_cast<uInt>(out.size() - stream.total_out);
+        result = inflate(&stream, Z_NO_FLUSH);
+    }
+    // Checks CRC and size of trailer
+    REQUIRE(result == Z_STREAM_END);
+    REQUIRE(stream.avail_in == 0);
+    out.resize(stream.total_out);
+    inflateEnd(&stream);
+    return out;
+}
+
+TEST_CASE("Gzip", "[tinja]") {
+    tinja::DataMap data;
+    data["V"] = "value";
+    data["A"] = tinja::Strings { "a", "b", "c" };
+    const std::vector<int> ints { 1, 2, 3 };
+    data["N"] = tinja::Column(ints);
+    const std::vector<std::string> sources {
+        "", "T", "{{V}}", "<p>{{V}}</p>", "<ul>{[<li>{{A}}:{{N}}</li>]}</ul>{{U}}<p>end</p>", "{{V}}{{V}}"
+    };
+    for (const auto& source : sources) {
+        CAPTURE(source);
+        const tinja::Template templ(source);
+        const tinja::GzipProgram gzip { tinja::Program(templ) };
+        REQUIRE(gunzip(gzip.render(data)) == templ.render(data));
+    }
+
+    // Large dynamic runs are compressed, longer than a stored block
+    tinja::DataMap large;
+    large["L"] = std::string(100000, 'x');
+    large["R"] = tinja::Strings(5000, "row");
+    tinja::GzipProgram gzip(tinja::Program(tinja::Template("<p>{{L}}</p>{[{{R}}]}<p>{{L}}</p>")));
+    const auto compressed = gzip.render(large);
+    REQUIRE(compressed.size() < 2000);
+    std::string rows;
+    for (int i = 0; i < 5000; ++i) {
+        rows += "row";
+    }
+    const auto text = "<p>" + std::string(100000, 'x') + "</p>";
+    REQUIRE(gunzip(compressed) == text + rows + text);
+    tinja::GzipProgram stored(tinja::Program(tinja::Template("<p>{{L}}</p>")), Z_BEST_COMPRESSION, 1000000);
+    REQUIRE(gunzip(stored.render(large)) == text);
+
+    // Bound programs and appending
+    tinja::Schema schema;
+    tinja::Program program(tinja::Template("<b>{{V}}</b>"));
+    program.bind(schema);
+    tinja::DataSlots slots(schema);
+    slots["V"] = "slot";
+    tinja::GzipProgram bound(std::move(program));
+    std::string out = "x";
+    bound.renderTo(slots, out);
+    REQUIRE(gunzip(out.substr(1)) == "<b>slot</b>");
+}
+
+TEST_CASE("Escaping", "[tinja]") {
+    // Special characters at every position of the vectorized blocks and tails
+    for (size_t size = 0; size < 80; ++size) {
+        for (size_t pos = 0; pos <= size; ++pos) {
+            std::string str(size, 'x');
+            std::string expected = str;
+            if (pos < size) {
+                str[pos] = '"';
+                expected.replace(pos, 1, "&quot;");
+            }
+            REQUIRE(tinja::findHtmlSpecial(str) == (pos < size ? pos : std::string::npos));
+            REQUIRE(tinja::escapedHtmlSize(std::string_view(str)) == expected.size());
+            std::string escaped;
+            tinja::appendEscapedHtml(escaped, str);
+            REQUIRE(escaped == expected);
+        }
+    }
+    std::string escaped;
+    tinja::appendEscapedHtml(escaped, "<a href=\"x\">Tom & Jerry's</a>");
+    REQUIRE(escaped == "&lt;a href=&quot;x&quot;&gt;Tom &amp; Jerry&#39;s&lt;/a&gt;");
+
+    const std::string clean = "clean";
+    const std::string dirty = "<b>";
+    const std::vector<std::string_view> views { "a&b", "c" };
+    const std::vector<double> numbers { 1.5, -2 };
+    tinja::DataMap data;
+    data["C"] = std::cref(clean);
+    data["D"] = std::cref(dirty);
+    data["S"] = std::string_view("'");
+    data["A"] = tinja::Strings { "<", "ok" };
+    data["N"] = tinja::Column(numbers);
+    data["W"] = tinja::Column(views);
+    const std::string source = "<p>{{C}}{{D}}{{S}}</p>{[<td>{{A}}|{{N}}|{{W}}</td>]}";
+    const std::string expected = "<p>clean&lt;b&gt;&#39;</p><td>&lt;|1.5|a&amp;b</td><td>ok|-2|c</td>";
+
+    tinja::Template templ;
+    templ.parse(source, { false, true });
+    REQUIRE(templ.render(data) == expected);
+    REQUIRE(templ.renderedSize(data) == expected.size());
+    REQUIRE(tinja::Template(source).render(data) == "<p>clean<b>'</p><td><|1.5|a&b</td><td>ok|-2|c</td>");
+
+    // Clean values are referenced, not copied
+    tinja::Template::Tokens tokens;
+    templ.renderTo(data, tokens);
+    REQUIRE(&tokens[1].get() == &clean);
+    REQUIRE(tokens[2].get() == "&lt;b&gt;");
+
+    tinja::TemplateView view;
+    view.parse(source, { false, true });
+    REQUIRE(view.render(data) == expected);
+
+    // Programs keep the policy, also in images
+    tinja::Program program(templ);
+    std::string rendered;
+    program.renderTo(data, tinja::StringSink { rendered });
+    REQUIRE(rendered == expected);
+    const auto image = program.serialize();
+    rendered.clear();
+    tinja::Program::view(image.data(), image.size()).renderTo(data, tinja::StringSink { rendered });
+    REQUIRE(rendered == expected);
+
+    // Parallel chunks
+    tinja::DataMap rows;
+    rows["A"] = tinja::Strings(100, "<>");
+    tinja::Template table;
+    table.parse("{[{{A}}]}", { false, true });
+    tinja::ThreadPool pool(2, 8);
+    std::string parallel;
+    table.renderTo(rows, tinja::StringSink { parallel }, pool);
+    REQUIRE(parallel == table.render(rows));
+    REQUIRE(parallel.size() == 100 * 8);
+
+    // Incremental renders escape values once per change
+    tinja::Template page;
+    page.parse("<p>{{D}}</p><p>{{V}}</p>", { false, true });
+    tinja::Schema schema;
+    page.bind(schema);
+    tinja::TrackedSlots slots(schema);
+    slots.set("D", "&");
+    slots.set("V", "1");
+    tinja::IncrementalRenderer<tinja::Template> renderer(page);
+    renderer.update(slots);
+    const auto* escapedToken = &renderer.tokens()[1].get();
+    REQUIRE(*escapedToken == "&amp;");
+    slots.set("V", "<2>");
+    renderer.update(slots);
+    REQUIRE(&renderer.tokens()[1].get() == escapedToken);
+    REQUIRE(renderer.tokens()[3].get() == "&lt;2&gt;");
+    REQUIRE(page.render(slots.slots()) == "<p>&amp;</p><p>&lt;2&gt;</p>");
+}
+
+TEST_CASE("Stats", "[tinja]") {
+    tinja::Template templ("<p>{{V}}</p>{[<li>{{A}}</li>]}{{U}}");
+    tinja::DataMap data;
+    data["V"] = "v";
+    data["A"] = tinja::Strings { "a", "b", "c" };
+    const auto doc = templ.render(data);
+    tinja::Template::Tokens tokens;
+    templ.renderTo(data, tokens);
+    std::string str;
+    templ.renderTo(data, tinja::StringSink { str });
+    const auto stats = templ.stats();
+
+#if TINJA_STATS
+    REQUIRE(stats.parses == 1);
+    REQUIRE(stats.renders == 3);
+    REQUIRE(stats.tokens == 3 * 12);
+    REQUIRE(stats.bytes == 3 * doc.size());
+    // V, A for the loop length, A in each iteration and U (render() also looks up A for its size)
+    REQUIRE(stats.lookups == 3 * 6 + 1);
+    REQUIRE(stats.missingKeys == 3);
+    REQUIRE(stats.loops == 3);
+    REQUIRE(stats.loopIterations == 3 * 3);
+
+    // Chunks and batch documents rendered on workers count for the template
+    templ.resetStats();
+    REQUIRE(templ.stats().renders == 0);
+    tinja::ThreadPool pool(2, 1);
+    data["A"] = tinja::Strings(100, "a");
+    REQUIRE(templ.render(data, pool) == templ.render(data));
+    REQUIRE(templ.stats().renders == 2);
+    REQUIRE(templ.stats().loopIterations == 2 * 100);
+    REQUIRE(templ.stats().bytes == 2 * templ.renderedSize(data));
+    templ.resetStats();
+    tinja::Batch batch;
+    templ.renderBatch(std::vector<tinja::DataMap>(10, data), batch, &pool);
+    REQUIRE(templ.stats().renders == 10);
+    REQUIRE(templ.stats().loopIterations == 10 * 100);
+    REQUIRE(templ.stats().bytes == batch.text().size());
+    REQUIRE(templ.stats().renderNanoseconds > 0);
+
+    // Copies start from zero
+    const auto copy = templ;
+    REQUIRE(copy.stats().renders == 0);
+
+    // Renders of other templates from a sink count for themselves
+    tinja::Template a("<{{V}}>");
+    tinja::Template b("{{V}}");
+    str.clear();
+    a.renderTo(data, [&](std::string_view token) {
+        str += token;
+        if (token == "v") {
+            b.renderTo(data, tinja::StringSink { str });
+        }
+    });
+    REQUIRE(str == "<vv>");
+    REQUIRE(a.stats().renders == 1);
+    REQUIRE(a.stats().lookups == 1);
+    REQUIRE(a.stats().tokens == 3);
+    REQUIRE(b.stats().renders == 1);
+    REQUIRE(b.stats().lookups == 1);
+    REQUIRE(b.stats().tokens == 1);
+
+    // Only top level templates hold counters
+    STATIC_REQUIRE(sizeof(tinja::Stats) == sizeof(void*));
+#else
+    // Disabled hooks add neither state nor counts
+    STATIC_REQUIRE(std::is_empty_v<tinja::Stats>);
+    struct Probe : tinja::Stats {
+        void* p;
+    };
+    STATIC_REQUIRE(sizeof(Probe) == sizeof(void*));
+    REQUIRE(stats.renders == 0);
+    REQUIRE(stats.tokens == 0);
+#endif
+}
+
+TEST_CASE("Nested arrays", "[tinja]") {
+    // Groups x and y with their rows { a, b, c } and { d, e } in CSR layout
+    const std::vector<std::string> names { "x", "y" };
+    const std::vector<std::string> values { "a", "b", "c", "d", "e" };
+    const std::vector<int> numbers { 1, 2, 3, 4, 5 };
+    const std::vector<uint32_t> offsets { 0, 3, 5 };
+    tinja::DataMap data;
+    data["T"] = "t";
+    data["G"] = tinja::Column(names);
+    data["R"] = tinja::JaggedColumn(values, offsets);
+    data["N"] = tinja::JaggedColumn(numbers, offsets);
+
+    // Arrays of the outer block keep their index within the nested block
+    static constexpr char page[] = "{{T}}{[<h>{{G}}</h>{[<{{G}}:{{R}}={{N}}>]}|]}";
+    const std::string expected = "t<h>x</h><x:a=1><x:b=2><x:c=3>|<h>y</h><y:d=4><y:e=5>|";
+    tinja::Template templ(page);
+    REQUIRE(templ.render(data) == expected);
+    REQUIRE(templ.renderedSize(data) == expected.size());
+    REQUIRE(tinja::TemplateView(page).render(data) == expected);
+
+    std::string staticStr;
+    tinja::StaticTemplate<page>().renderTo(data, tinja::StringSink { staticStr });
+    REQUIRE(staticStr == expected);
+
+    tinja::Template streamed;
+    tinja::StreamParser<tinja::Template> parser(streamed);
+    for (const auto c : std::string_view(page)) {
+        parser.feed(std::string_view(&c, 1));
+    }
+    parser.finish();
+    REQUIRE(streamed.render(data) == expected);
+
+    tinja::Schema schema;
+    templ.bind(schema);
+    tinja::TrackedSlots slots(schema);
+    for (const auto& [key, value] : data) {
+        slots.set(key, value);
+    }
+    tinja::Program program(templ);
+    std::string programStr;
+    program.renderTo(slots.slots(), tinja::StringSink { programStr });
+    REQUIRE(programStr == expected);
+
+    tinja::IncrementalRenderer<tinja::Template> renderer(templ);
+    std::string incrementalStr;
+    for (const auto& t : renderer.update(slots)) {
+        incrementalStr += t.get();
+    }
+    REQUIRE(incrementalStr == expected);
+
+    tinja::ThreadPool pool(2, 1);
+    REQUIRE(templ.render(data, pool) == expected);
+
+    // Three levels: regions r and s with groups { g0, g1 } and { g2 }, rows { a, b }, { c } and { d, e }
+    const std::vector<std::string> groups { "g0", "g1", "g2" };
+    const std::vector<size_t> regionOffsets { 0, 2, 3 };
+    const std::vector<size_t> groupOffsets { 0, 2, 3, 5 };
+    data["Region"] = tinja::Strings { "r", "s" };
+    data["Group"] = tinja::JaggedColumn(groups, regionOffsets);
+    data["Value"] = tinja::JaggedColumn(values, { regionOffsets, groupOffsets });
+    static constexpr char levels[] = "{[{{Region}}:{[{{Group}}({[{{Value}}]})]};]}";
+    REQUIRE(tinja::Template(levels).render(data) == "r:g0(ab)g1(c);s:g2(de);");
+    std::string levelsStr;
+    tinja::Program(tinja::Template(levels)).renderTo(data, tinja::StringSink { levelsStr });
+    REQUIRE(levelsStr == "r:g0(ab)g1(c);s:g2(de);");
+    levelsStr.clear();
+    tinja::StaticTemplate<levels>().renderTo(data, tinja::StringSink { levelsStr });
+    REQUIRE(levelsStr == "r:g0(ab)g1(c);s:g2(de);");
+
+    // Blocks without data of their level render once, missing keys only empty their own block
+    REQUIRE(tinja::Template("{[{[{{G}}]}]}").render(data) == "xy");
+    REQUIRE(tinja::Template("{[{{G}}{[<{{M}}>]}]}").render(data) == "xy");
+    const std::vector<uint32_t> emptyFirst { 0, 0, 2 };
+    data["E"] = tinja::JaggedColumn(numbers, emptyFirst);
+    REQUIRE(tinja::Template("{[{{G}}({[{{E}}]})]}").render(data) == "x()y(12)");
+    REQUIRE_THROWS_AS(tinja::JaggedColumn(values, names), std::invalid_argument);
+
+    // Malformed offsets are rejected on construction instead of rendering empty rows or throwing later
+    const std::vector<int> five { 1, 2, 3, 4, 5 };
+    const std::vector<int32_t> negative { 0, -1, 5 };
+    const std::vector<int32_t> descending { 0, 3, 2, 5 };
+    const std::vector<uint32_t> beyond { 0, 3, 6 };
+    // Outer offsets index the 2 rows of the inner level
+    const std::vector<uint32_t> outer { 0, 1, 3 };
+    const std::vector<uint32_t> inner { 0, 2, 5 };
+    REQUIRE_THROWS_AS(tinja::JaggedColumn(five, negative), std::invalid_argument);
+    REQUIRE_THROWS_AS(tinja::JaggedColumn(five, descending), std::invalid_argument);
+    REQUIRE_THROWS_AS(tinja::JaggedColumn(five, beyond), std::invalid_argument);
+    REQUIRE_THROWS_AS(tinja::JaggedColumn(five, { outer, inner }), std::invalid_argument);
+    const std::vector<uint32_t> rows { 0, 1, 2 };
+    REQUIRE_NOTHROW(tinja::JaggedColumn(five, { rows, inner }));
+
+    // Jagged columns of temporaries would dangle
+    using Offsets = std::vector<uint32_t>;
+    STATIC_REQUIRE(!std::is_constructible_v<tinja::JaggedColumn, std::vector<int>&&, const Offsets&>);
+    STATIC_REQUIRE(!std::is_constructible_v<tinja::JaggedColumn, const std::vector<int>&, Offsets&&>);
+    STATIC_REQUIRE(!std::is_constructible_v<tinja::JaggedColumn, std::vector<int>&&, std::vector<tinja::Column>>);
+    STATIC_REQUIRE(std::is_constructible_v<tinja::JaggedColumn, const std::vector<int>&, const Offsets&>);
+    STATIC_REQUIRE(std::is_constructible_v<tinja::JaggedColumn, const std::vector<int>&, std::vector<tinja::Column>>);
+}
@@ -0,0 +1,62 @@
+// Compiles a template to a binary program image, which tinja::Program::view() loads without parsing.
+//
+//   tinjac page.html page.tinja           writes the image
+//   tinjac page.html page.hpp pageImage   writes a header with the image as aligned byte array
+//
+// Options (before the arguments): --minify removes whitespace between HTML tags, --escape escapes
+// HTML special characters of all variables while rendering.
+
+#include <tinja.hpp>
+
+#include <fstream>
+#include <iostream>
+#include <sstream>
+
+int main(int argc, char* argv[]) {
+    tinja::ParseOptions options;
+    const auto* program = argv[0];
+    for (; argc > 1 && argv[1][0] == '-' && argv[1][1] == '-'; --argc, ++argv) {
+        if (std::string(argv[1]) == "--minify") {
+            options.minifyHtml = true;
+        } else if (std::string(argv[1]) == "--escape") {
+            options.escapeHtml = true;
+        } else {
+            argc = 0;
+            break;
+        }
+    }
+    if (argc != 3 && argc != 4) {
+        std::cerr << "usage: " << program << " [--minify] [--escape] <template> <image> [<array name>]" << std::endl;
+        return 1;
+    }
+
+    std::ifstream in(argv[1], std::ios::binary);
+    if (!in) {
+        std::cerr << "tinjac: cannot read " << argv[1] << std::endl;
+        return 1;
+    }
+    std::stringstream source;
+    source << in.rdbuf();
+
+    tinja::TemplateView templ;
+    templ.parse(source.str(), options);
+    const auto image = tinja::Program(templ).serialize();
+
+    std::ofstream out(argv[2], std::ios::binary);
+    if (argc == 3) {
+        out.write(image.data(), static_cast<std::streamsize>(image.size()));
+    } else {
+        out << "#pragma once\n\n"
+            << "// Generated by tinjac from " << argv[1] << "\n"
+            << "alignas(4) static const unsigned char " << argv[3] << "[] = {";
+        for (size_t i = 0; i < image.size(); ++i) {
+            out << (i % 16 ? " " : "\n    ") << static_cast<unsigned>(static_cast<unsigned char>(image[i])) << ",";
+        }
+        out << "\n};\n";
+    }
+    if (!out) {
+        std::cerr << "tinjac: cannot write " << argv[2] << std::endl;
+        return 1;
+    }
+    return 0;
+}